@@ -0,0 +1,393 @@
+/**@file      bench.c
+ * @brief     Benchmarks for the parts of the terminal that do not draw
+ *            anything, built without any graphics library. The parser is
+ *            fed generated corpora, or recorded sessions named on the
+ *            command line, and its throughput reported.
+ * @copyright Richard James Howe (2017)
+ * @license   MIT */
+
+#include "vt100.h"
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_WIDTH      (80)
+#define BENCHMARK_HEIGHT     (40)
+#define BENCHMARK_BYTES      (1ul << 22) /* per generated corpus */
+#define BENCHMARK_ITERATIONS (4)
+#define BENCHMARK_READ_CHUNK (1ul << 16)
+
+#define BENCHMARK_FRAMES     (2000)
+#define BENCHMARK_FIFO_SIZE  (1ul << 16)
+
+typedef struct { /* the layout vt100_attribute_t used to have, for comparison */
+	unsigned bold:          1;
+	unsigned under_score:   1;
+	unsigned blink:         1;
+	unsigned reverse_video: 1;
+	unsigned conceal:       1;
+	unsigned foreground_color: 3;
+	unsigned background_color: 3;
+} benchmark_bitfield_t;
+
+static double benchmark_ns_per_cell(clock_t start, size_t cells)
+{
+	return ((double)(clock() - start) / CLOCKS_PER_SEC) * 1e9 / (double)cells;
+}
+
+/**@brief compare the bit field and packed attribute layouts on the two
+ * paths that touch every cell, filling a screen with the current attribute
+ * as vt100_write() does and pulling out the background color as the
+ * renderer does */
+static void benchmark_attributes(void)
+{
+	const size_t cells = BENCHMARK_WIDTH * BENCHMARK_HEIGHT, total = cells * BENCHMARK_FRAMES;
+	benchmark_bitfield_t *bits   = allocate_or_die(cells * sizeof(bits[0]));
+	vt100_attribute_t    *packed = allocate_or_die(cells * sizeof(packed[0]));
+	volatile unsigned sink = 0;
+	unsigned sum = 0;
+
+	clock_t start = clock();
+	for(unsigned f = 0; f < BENCHMARK_FRAMES; f++) {
+		const benchmark_bitfield_t b = { .foreground_color = f, .background_color = f >> 3, .bold = f >> 6 };
+		for(size_t i = 0; i < cells; i++)
+			memcpy(&bits[i], &b, sizeof(b));
+	}
+	note("write, bit field:  %.3f ns/cell", benchmark_ns_per_cell(start, total));
+
+	start = clock();
+	for(unsigned f = 0; f < BENCHMARK_FRAMES; f++) {
+		const vt100_attribute_t a = VT100_ATTRIBUTE(f, f >> 3, (f >> 6) & 1 ? VT100_BOLD : 0);
+		for(size_t i = 0; i < cells; i++)
+			packed[i] = a;
+	}
+	note("write, packed:     %.3f ns/cell", benchmark_ns_per_cell(start, total));
+
+	start = clock();
+	for(unsigned f = 0; f < BENCHMARK_FRAMES; f++)
+		for(size_t i = 0; i < cells; i++)
+			sum += bits[i].background_color;
+	note("render, bit field: %.3f ns/cell", benchmark_ns_per_cell(start, total));
+
+	start = clock();
+	for(unsigned f = 0; f < BENCHMARK_FRAMES; f++)
+		for(size_t i = 0; i < cells; i++)
+			sum += vt100_background(packed[i]);
+	note("render, packed:    %.3f ns/cell", benchmark_ns_per_cell(start, total));
+
+	sink = sum;
+	UNUSED(sink);
+	free(packed);
+	free(bits);
+}
+
+/**@brief move bytes through a FIFO one at a time and in blocks of various
+ * sizes, filling it then emptying it each round as the PTY reader and the
+ * display thread would */
+static void benchmark_fifo(void)
+{
+	static const size_t blocks[] = { 1, 16, 256, 4096, 65536 };
+	fifo_t *fifo = fifo_new(BENCHMARK_FIFO_SIZE);
+	uint8_t *in  = allocate_or_die(fifo->size);
+	uint8_t *out = allocate_or_die(fifo->size);
+	const size_t total = BENCHMARK_BYTES * BENCHMARK_ITERATIONS;
+	size_t moved = 0;
+
+	clock_t start = clock();
+	for(moved = 0; moved < total;) {
+		for(size_t i = 0; !fifo_is_full(fifo); i++)
+			fifo_push(fifo, in[i]);
+		for(size_t i = 0; fifo_pop(fifo, &out[i]); i++)
+			moved++;
+	}
+	note("fifo_push/fifo_pop:      %.3f ns/byte", benchmark_ns_per_cell(start, moved));
+
+	for(size_t b = 0; b < sizeof(blocks)/sizeof(blocks[0]); b++) {
+		start = clock();
+		for(moved = 0; moved < total;) {
+			for(size_t i = 0; fifo_push_n(fifo, &in[i], blocks[b]); i += blocks[b])
+				;
+			for(size_t i = 0, n = 0; (n = fifo_pop_n(fifo, &out[i], blocks[b])); i += n)
+				moved += n;
+		}
+		note("fifo_push_n/fifo_pop_n %5zu: %.3f ns/byte", blocks[b], benchmark_ns_per_cell(start, moved));
+	}
+
+	free(out);
+	free(in);
+	fifo_free(fifo);
+}
+
+/* The corpora are generated from a fixed seed so every run, and every
+ * machine, parses the same bytes. Output is assumed to have gone through a
+ * terminal line discipline, so lines end in "\r\n". */
+
+typedef struct {
+	const char *name;
+	uint8_t *data;
+	size_t length;
+	size_t capacity;
+	uint32_t seed;
+} corpus_t;
+
+static uint32_t corpus_random(corpus_t *c)
+{
+	c->seed ^= c->seed << 13;
+	c->seed ^= c->seed >> 17;
+	c->seed ^= c->seed << 5;
+	return c->seed;
+}
+
+static bool corpus_full(const corpus_t *c)
+{
+	return c->length >= c->capacity;
+}
+
+/**@brief append formatted text, truncated at the end of the corpus */
+static void corpus_printf(corpus_t *c, const char *fmt, ...)
+{
+	char buf[256];
+	va_list ap;
+	va_start(ap, fmt);
+	const int r = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	const size_t n = MIN((size_t)MAX(r, 0), MIN(sizeof(buf) - 1, c->capacity - c->length));
+	memcpy(&c->data[c->length], buf, n);
+	c->length += n;
+}
+
+static void corpus_words(corpus_t *c, unsigned count)
+{
+	static const char *words[] = {
+		"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+		"terminal", "escape", "sequence", "0x1b", "42", "buffer", "*",
+	};
+	for(unsigned i = 0; i < count; i++)
+		corpus_printf(c, i ? " %s" : "%s", words[corpus_random(c) % (sizeof(words)/sizeof(words[0]))]);
+}
+
+/**@brief lines of printable text, as from 'cat' on a source file */
+static void corpus_plain(corpus_t *c)
+{
+	while(!corpus_full(c)) {
+		corpus_words(c, corpus_random(c) % 14);
+		corpus_printf(c, "\r\n");
+	}
+}
+
+/**@brief colored compiler diagnostics, an SGR sequence every few words */
+static void corpus_sgr(corpus_t *c)
+{
+	static const char *kinds[] = { "\x1b[1;31merror", "\x1b[1;35mwarning", "\x1b[1;36mnote" };
+	while(!corpus_full(c)) {
+		const uint32_t r = corpus_random(c);
+		corpus_printf(c, "\x1b[1msrc/file%u.c:%u:%u: %s: \x1b[0m", r % 64, r % 2000, r % 80, kinds[r % 3]);
+		corpus_words(c, 4 + (r % 6));
+		corpus_printf(c, " [\x1b[1;35m-Wextra\x1b[0m]\r\n    ");
+		corpus_words(c, 6);
+		corpus_printf(c, "\r\n    \x1b[1;32m^~~~\x1b[0m\r\n");
+	}
+}
+
+/**@brief full screen redraws addressed cell by cell, as 'top' does */
+static void corpus_cursor(corpus_t *c)
+{
+	while(!corpus_full(c)) {
+		corpus_printf(c, "\x1b[H\x1b[7m  PID USER      PR  NI    VIRT    RES  %%CPU  %%MEM     TIME+ COMMAND\x1b[0m");
+		for(unsigned y = 2; y <= BENCHMARK_HEIGHT && !corpus_full(c); y++) {
+			const uint32_t r = corpus_random(c);
+			corpus_printf(c, "\x1b[%u;1H%5u %-8s %3u %3d %7u %6u %5u.%u %5u.%u %6u:%02u.%02u %s\x1b[K",
+				y, r % 32768, r & 1 ? "root" : "user", 20, 0, r % 9999999, r % 999999,
+				r % 100, r % 10, (r >> 8) % 100, (r >> 4) % 10, r % 999, r % 60, r % 100,
+				(r & 2) ? "\x1b[1mbash\x1b[m" : "sshd");
+		}
+		corpus_printf(c, "\x1b[%u;%uH", 1 + (corpus_random(c) % BENCHMARK_HEIGHT), 1 + (corpus_random(c) % BENCHMARK_WIDTH));
+	}
+}
+
+/**@brief random escape sequences, control characters and broken
+ * sequences, the worst case for the state machine, with the alternate
+ * screens and scrolling regions switched in and out along the way */
+static void corpus_spam(corpus_t *c)
+{
+	static const char finals[] = "ABCDHJKfmhlsunr@PXLMST";
+	static const unsigned modes[] = { 1, 6, 7, 25, 47, 1047, 1049 };
+	while(!corpus_full(c)) {
+		const uint32_t r = corpus_random(c);
+		switch(r % 6) {
+		case 0: corpus_printf(c, "\x1b[%u%c", r % 200, finals[(r >> 8) % (sizeof(finals) - 1)]); break;
+		case 1: corpus_printf(c, "\x1b[%u;%u%c", r % 100, (r >> 8) % 100, finals[(r >> 16) % (sizeof(finals) - 1)]); break;
+		case 2: corpus_printf(c, "\x1b[?%u%c", modes[(r >> 16) % (sizeof(modes)/sizeof(modes[0]))], (r >> 8) & 1 ? 'h' : 'l'); break;
+		case 3: corpus_printf(c, "\x1b%c", (char)(32 + ((r >> 8) % 95))); break;
+		case 4: corpus_printf(c, "%c", (char)((r >> 8) % 32)); break;
+		default: c->data[c->length++] = r >> 8; break; /* any byte at all */
+		}
+	}
+}
+
+static corpus_t *corpus_new(const char *name, size_t capacity)
+{
+	corpus_t *c = allocate_or_die(sizeof(*c));
+	c->name = name;
+	c->capacity = capacity;
+	c->data = allocate_or_die(capacity);
+	c->seed = 2463534242u;
+	return c;
+}
+
+static void corpus_free(corpus_t *c)
+{
+	if(!c)
+		return;
+	free(c->data);
+	free(c);
+}
+
+/**@brief load a recorded session, for example one saved with 'script' */
+static corpus_t *corpus_load(const char *file)
+{
+	FILE *f = fopen_or_die(file, "rb");
+	corpus_t *c = corpus_new(file, BENCHMARK_READ_CHUNK);
+	for(size_t r = 1; r;) {
+		if(corpus_full(c)) {
+			c->capacity *= 2;
+			c->data = realloc(c->data, c->capacity);
+			if(!c->data)
+				fatal("could not grow corpus '%s' to %zu bytes", file, c->capacity);
+		}
+		r = fread(&c->data[c->length], 1, c->capacity - c->length, f);
+		c->length += r;
+	}
+	if(ferror(f))
+		fatal("could not read corpus '%s'", file);
+	fclose(f);
+	return c;
+}
+
+/**@brief compare the cells of a screen, the order of its rows and which
+ * of them run on to the next */
+static bool benchmark_screen_same(const vt100_t *t, const vt100_screen_t *a, const vt100_screen_t *b)
+{
+	assert(t && a && b);
+	return a->top == b->top
+		&& !memcmp(a->m, b->m, t->size)
+		&& !memcmp(a->attributes, b->attributes, t->size * sizeof(a->attributes[0]))
+		&& !memcmp(a->wrapped, b->wrapped, t->height * sizeof(a->wrapped[0]))
+		&& !memcmp(a->rows, b->rows, t->height * sizeof(a->rows[0]));
+}
+
+/**@brief compare two heap scrollbacks line by line, the arena is compacted
+ * the same way on both so the kept lines must be at the same places */
+static bool benchmark_scrollback_same(const vt100_scrollback_t *a, const vt100_scrollback_t *b)
+{
+	assert(a && b);
+	assert(!(a->segment) && !(b->segment));
+	if(a->count != b->count || a->pushed != b->pushed || a->head != b->head || a->capacity != b->capacity)
+		return false;
+	for(size_t i = 0; i < a->capacity; i++) {
+		const vt100_line_t *x = &a->index[i], *y = &b->index[i];
+		if(x->offset != y->offset || x->length != y->length || x->runs != y->runs || x->wrapped != y->wrapped)
+			return false;
+	}
+	return a->arena_start == b->arena_start && a->arena_used == b->arena_used
+		&& (a->arena_used == a->arena_start || !memcmp(&a->arena[a->arena_start], &b->arena[b->arena_start], a->arena_used - a->arena_start));
+}
+
+/**@brief everything parsing can change, both screens, the cursor and what
+ * is saved of it, the modes, and the scrollback */
+static bool benchmark_same(const vt100_t *a, const vt100_t *b)
+{
+	assert(a && b);
+	const vt100_screen_t x = { .m = a->m, .attributes = a->attributes, .wrapped = a->wrapped, .rows = a->rows, .top = a->top };
+	const vt100_screen_t y = { .m = b->m, .attributes = b->attributes, .wrapped = b->wrapped, .rows = b->rows, .top = b->top };
+	return a->cursor == b->cursor
+		&& a->cursor_saved == b->cursor_saved
+		&& a->cursor_alternate_saved == b->cursor_alternate_saved
+		&& a->scroll_top == b->scroll_top && a->scroll_bottom == b->scroll_bottom
+		&& a->state == b->state
+		&& a->attribute == b->attribute
+		&& a->wrap_pending == b->wrap_pending
+		&& a->cursor_on == b->cursor_on && a->cursor_keys == b->cursor_keys
+		&& a->blinks == b->blinks && a->alternate == b->alternate
+		&& !strcmp(a->title, b->title)
+		&& benchmark_screen_same(a, &x, &y)
+		&& benchmark_screen_same(a, &a->other, &b->other)
+		&& benchmark_scrollback_same(&a->scrollback, &b->scrollback);
+}
+
+/**@brief run a corpus through both vt100_update() and vt100_write() on a
+ * fresh terminal each, report the throughput of each, the resulting
+ * terminals must match, returns false if they do not */
+static bool benchmark_corpus(const corpus_t *c)
+{
+	assert(c);
+	vt100_t *bytewise = vt100_new(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, VT100_SCROLLBACK_LINES);
+	vt100_t *bulk     = vt100_new(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, VT100_SCROLLBACK_LINES);
+	double elapsed[2] = { 0., 0. };
+
+	for(unsigned j = 0; j < BENCHMARK_ITERATIONS; j++) {
+		clock_t start = clock();
+		for(size_t i = 0; i < c->length; i++)
+			vt100_update(bytewise, c->data[i]);
+		elapsed[0] += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		vt100_write(bulk, c->data, c->length);
+		elapsed[1] += (double)(clock() - start) / CLOCKS_PER_SEC;
+	}
+
+	const double bytes = (double)c->length * BENCHMARK_ITERATIONS, megabytes = bytes / (1024. * 1024.);
+	for(unsigned j = 0; j < 2; j++)
+		note("%-8s %-12s %8.2f MB/s %7.3f ns/byte", c->name, j ? "vt100_write" : "vt100_update",
+			megabytes / MAX(elapsed[j], 1e-9), (elapsed[j] * 1e9) / MAX(bytes, 1.));
+	const vt100_scrollback_t *s = &bulk->scrollback;
+	if(s->count)
+		note("%-8s %-12s %8.1f bytes/line, %zu uncompressed", c->name, "scrollback",
+			(double)(s->arena_used - s->arena_start) / s->count, bulk->width * (1 + sizeof(vt100_attribute_t)));
+
+	const bool same = benchmark_same(bytewise, bulk);
+	if(!same)
+		error("%s: vt100_update and vt100_write disagree", c->name);
+
+	vt100_free(bulk);
+	vt100_free(bytewise);
+	return same;
+}
+
+/**@brief run the generated corpora, or the recorded sessions named on the
+ * command line, through the parser with no rendering, then the data
+ * structure benchmarks */
+int main(int argc, char **argv)
+{
+	static const struct { const char *name; void (*generate)(corpus_t *c); } generated[] = {
+		{ "plain",  corpus_plain  },
+		{ "sgr",    corpus_sgr    },
+		{ "cursor", corpus_cursor },
+		{ "spam",   corpus_spam   },
+	};
+	bool same = true;
+
+	log_level = LOG_NOTE;
+	note("%u iterations, %s scanner", BENCHMARK_ITERATIONS, vt100_scanner());
+	if(argc > 1) {
+		for(int i = 1; i < argc; i++) {
+			corpus_t *c = corpus_load(argv[i]);
+			same = benchmark_corpus(c) && same;
+			corpus_free(c);
+		}
+		return same ? 0 : 1;
+	}
+
+	for(size_t i = 0; i < sizeof(generated)/sizeof(generated[0]); i++) {
+		corpus_t *c = corpus_new(generated[i].name, BENCHMARK_BYTES);
+		generated[i].generate(c);
+		same = benchmark_corpus(c) && same;
+		corpus_free(c);
+	}
+
+	benchmark_attributes();
+	benchmark_fifo();
+	return same ? 0 : 1;
+}
@@ -0,0 +1,1296 @@
+/**@file      gui.c
+ * @brief     GLUT front end, draws the screen kept by vt100.c and passes key
+ *            presses on to the shell
+ * @copyright Richard James Howe (2017)
+ * @license   MIT */
+
+#include "vt100.h"
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define GL_GLEXT_PROTOTYPES /* for the vertex buffer object functions */
+#include <GL/gl.h>
+#include <GL/glut.h>
+#include <GL/freeglut_ext.h> /* for glutStrokeHeight */
+
+#define VGA_BUFFER_LENGTH          (1 << 13)
+#define VGA_WIDTH                  (80)
+#define VGA_HEIGHT                 (40)
+#define VGA_AREA                   (VGA_WIDTH * VGA_HEIGHT)
+
+#define VGA_CTL_B_BIT              (0)
+#define VGA_CTL_G_BIT              (1)
+#define VGA_CTL_R_BIT              (2)
+#define VGA_CUR_MODE_BIT           (3)
+#define VGA_CUR_BLINK_BIT          (4)
+#define VGA_CUR_EN_BIT             (5)
+#define VGA_EN_BIT                 (6)
+#define VGA_SCREEN_SELECT_BIT      (7)
+
+#define VGA_CTL_B                  (1 << VGA_CTL_B_BIT)
+#define VGA_CTL_G                  (1 << VGA_CTL_G_BIT)
+#define VGA_CTL_R                  (1 << VGA_CTL_R_BIT)
+#define VGA_CUR_MODE               (1 << VGA_CUR_MODE_BIT)
+#define VGA_CUR_BLINK              (1 << VGA_CUR_BLINK_BIT)
+#define VGA_CUR_EN                 (1 << VGA_CUR_EN_BIT)
+#define VGA_EN                     (1 << VGA_EN_BIT)
+#define VGA_SCREEN_SELECT          (1 << VGA_SCREEN_SELECT_BIT)
+
+/* ====================================== Utility Functions ==================================== */
+
+#define PI               (3.1415926535897932384626433832795)
+#define X_MAX            (100.0)
+#define X_MIN            (0.0)
+#define Y_MAX            (100.0)
+#define Y_MIN            (0.0)
+#define LINE_WIDTH       (0.5)
+#define TARGET_FPS       (30.0)
+#define PARSE_BUDGET     (0.75 / TARGET_FPS) /* seconds of each frame spent parsing */
+#define BACKGROUND_ON    (false)
+
+typedef struct {
+	double window_height;
+	double window_width;
+	double window_x_starting_position;
+	double window_y_starting_position;
+	double window_scale_x;
+	double window_scale_y;
+	volatile unsigned tick;
+	volatile bool     halt_simulation;
+	bool redraw; /* a redisplay has been asked for, posted on the next tick */
+	unsigned arena_tick_ms;
+	double parse_budget; /* seconds of input parsing allowed per tick */
+	bool use_uart_input;
+	bool debug_extra;
+	bool step;
+	bool debug_mode;
+	bool use_glyph_atlas; /* draw with the glyph atlas, not stroke characters */
+	bool show_statistics; /* overlay the frame statistics */
+	void *font_scaled;
+} world_t;
+
+static world_t world = {
+	.window_height               = 800.0,
+	.window_width                = 800.0,
+	.window_x_starting_position  = 60.0,
+	.window_y_starting_position  = 20.0,
+	.window_scale_x              = 1.0,
+	.window_scale_y              = 1.0,
+	.tick                        = 0,
+	.halt_simulation             = false,
+	.redraw                      = true,
+	.arena_tick_ms               = (unsigned)(1000.0 / TARGET_FPS), /* also caps the frame rate */
+	.parse_budget                = PARSE_BUDGET,
+	.use_uart_input              = true,
+	.debug_extra                 = false,
+	.step                        = false,
+	.debug_mode                  = false,
+	.use_glyph_atlas             = true,
+	.show_statistics             = false,
+	.font_scaled                 = GLUT_STROKE_MONO_ROMAN
+};
+
+typedef enum {
+	TRIANGLE,
+	SQUARE,
+	PENTAGON,
+	HEXAGON,
+	SEPTAGON,
+	OCTAGON,
+	DECAGON,
+	CIRCLE,
+	INVALID_SHAPE
+} shape_e;
+
+typedef shape_e shape_t;
+
+typedef struct {
+	double x;
+	double y;
+} scale_t;
+
+typedef struct {
+	double x, y;
+	bool draw_border;
+	color_t color_text, color_box;
+	double width, height;
+} textbox_t;
+
+typedef struct { /**@note it might be worth translating some functions to use points*/
+	double x, y;
+} point_t;
+
+/**@bug not quite correct, arena_tick_ms is what we request, not want the arena
+ * tick actually is */
+static double seconds_to_ticks(const world_t *world, double s)
+{
+	assert(world);
+	return s * (1000. / (double)world->arena_tick_ms);
+}
+
+static double rad2deg(double rad)
+{
+	return (rad / (2.0 * PI)) * 360.0;
+}
+
+/**@brief the eight basic colors are drawn dim unless 'light', as the
+ * hardware drew them, the rest of the 256 color palette is drawn as is */
+static void color_rgb(unsigned color, bool light, double rgb[3])
+{
+	static const uint8_t channels[][3] = {
+		/*            RED GRN BLU */
+		[BLACK]   = { 0,  0,  0 },
+		[RED]     = { 1,  0,  0 },
+		[GREEN]   = { 0,  1,  0 },
+		[YELLOW]  = { 1,  1,  0 },
+		[BLUE]    = { 0,  0,  1 },
+		[MAGENTA] = { 1,  0,  1 },
+		[CYAN]    = { 0,  1,  1 },
+		[WHITE]   = { 1,  1,  1 },
+	};
+	const double on = light ? 0.8 : 0.4;
+	if(color <= WHITE) {
+		for(size_t i = 0; i < 3; i++)
+			rgb[i] = on * channels[color][i];
+		return;
+	}
+	uint8_t c[3];
+	vt100_palette(color, c);
+	for(size_t i = 0; i < 3; i++)
+		rgb[i] = c[i] / 255.0;
+}
+
+static void set_color(unsigned color, bool light)
+{
+	double rgb[3];
+	color_rgb(color, light, rgb);
+	glColor3d(rgb[0], rgb[1], rgb[2]);
+}
+
+/* see: https://www.opengl.org/discussion_boards/showthread.php/160784-Drawing-Circles-in-OpenGL */
+static void _draw_regular_polygon(
+		double x, double y,
+		double orientation,
+		double radius, double sides,
+		bool lines, double thickness,
+		color_t color)
+{
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+		glLoadIdentity();
+		glTranslatef(x, y, 0.0);
+		glRotated(rad2deg(orientation), 0, 0, 1);
+		set_color(color, true);
+		if(lines) {
+			glLineWidth(thickness);
+			glBegin(GL_LINE_LOOP);
+		} else {
+			glBegin(GL_POLYGON);
+		}
+			for(double i = 0; i < 2.0 * PI; i += PI / sides)
+				glVertex3d(cos(i) * radius, sin(i) * radius, 0.0);
+		glEnd();
+	glPopMatrix();
+}
+
+static void _draw_rectangle(double x, double y, double width, double height, bool lines, double thickness, color_t color)
+{
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+		glLoadIdentity();
+		glRasterPos2d(x, y);
+		set_color(color, true);
+		if(lines) {
+			glLineWidth(thickness);
+			glBegin(GL_LINE_LOOP);
+		} else {
+			glBegin(GL_POLYGON);
+		}
+		glVertex3d(x,       y,        0);
+		glVertex3d(x+width, y,        0);
+		glVertex3d(x+width, y+height, 0);
+		glVertex3d(x,       y+height, 0);
+		glEnd();
+	glPopMatrix();
+}
+
+static void draw_rectangle_filled(double x, double y, double width, double height, color_t color)
+{
+	return _draw_rectangle(x, y, width, height, false, 0, color);
+}
+
+static void draw_rectangle_line(double x, double y, double width, double height, double thickness, color_t color)
+{
+	return _draw_rectangle(x, y, width, height, true, thickness, color);
+}
+
+static double shape_to_sides(shape_t shape)
+{
+	static const double sides[] =
+	{
+		[TRIANGLE] = 1.5,
+		[SQUARE]   = 2,
+		[PENTAGON] = 2.5,
+		[HEXAGON]  = 3,
+		[SEPTAGON] = 3.5,
+		[OCTAGON]  = 4,
+		[DECAGON]  = 5,
+		[CIRCLE]   = 24
+	};
+	if(shape >= INVALID_SHAPE)
+		fatal("invalid shape '%d'", shape);
+	return sides[shape % INVALID_SHAPE];
+}
+
+/* static void draw_regular_polygon_filled(double x, double y, double orientation, double radius, shape_t shape, color_t color)
+{
+	double sides = shape_to_sides(shape);
+	_draw_regular_polygon(x, y, orientation, radius, sides, false, 0, color);
+} */
+
+static void draw_regular_polygon_line(double x, double y, double orientation, double radius, shape_t shape, double thickness, color_t color)
+{
+	double sides = shape_to_sides(shape);
+	_draw_regular_polygon(x, y, orientation, radius, sides, true, thickness, color);
+}
+
+static void draw_char(uint8_t c)
+{
+	c = c >= 32 && c <= 127 ? c : '?';
+	glutStrokeCharacter(world.font_scaled, c);
+}
+
+/* see: https://en.wikibooks.org/wiki/OpenGL_Programming/Modern_OpenGL_Tutorial_Text_Rendering_01
+ *      https://stackoverflow.com/questions/538661/how-do-i-draw-text-with-glut-opengl-in-c
+ *      https://stackoverflow.com/questions/20866508/using-glut-to-simply-print-text */
+static int draw_block(const uint8_t *msg, size_t len)
+{
+	assert(msg);
+	for(size_t i = 0; i < len; i++)
+		draw_char(msg[i]);
+	return len;
+}
+
+static int draw_string(const char *msg)
+{
+	assert(msg);
+	return draw_block((uint8_t*)msg, strlen(msg));
+}
+
+static scale_t font_attributes(void)
+{
+	static bool initialized = false;
+	static scale_t scale = { 0., 0.};
+	if(initialized)
+		return scale;
+	scale.y = glutStrokeHeight(world.font_scaled);
+	scale.x = glutStrokeWidth(world.font_scaled, 'M');
+	initialized = true;
+	return scale;
+}
+
+static void draw_vt100_char(double x, double y, double scale_x, double scale_y, double orientation, uint8_t c, const vt100_attribute_t *attr, bool blink)
+{
+	/*scale_t scale = font_attributes();
+	double char_width  = scale.x / X_MAX;
+       	double char_height = scale.y / Y_MAX;*/
+
+	if(blink && vt100_flag(*attr, VT100_BLINK))
+		return;
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+		glLoadIdentity();
+		glTranslatef(x, y, 0.0);
+		glScaled(scale_x, scale_y, 1.0);
+		glRotated(rad2deg(orientation), 0, 0, 1);
+		set_color(vt100_foreground(*attr), vt100_flag(*attr, VT100_BOLD));
+		draw_char(vt100_flag(*attr, VT100_CONCEAL) ? '*' : c);
+		glEnd();
+	glPopMatrix();
+	if(BACKGROUND_ON)
+		draw_rectangle_filled(x, y, 1.20, 1.55, vt100_background(*attr));
+}
+
+static int draw_vt100_block(double x, double y, double scale_x, double scale_y, double orientation, const uint8_t *msg, size_t len, const vt100_attribute_t *attr, bool blink)
+{
+	scale_t scale = font_attributes();
+	double char_width = (scale.x / X_MAX)*1.1;
+	for(size_t i = 0; i < len; i++)
+		draw_vt100_char(x+char_width*i, y, scale_x, scale_y, orientation, msg[i], &attr[i], blink);
+	return len;
+}
+
+static int draw_block_scaled(double x, double y, double scale_x, double scale_y, double orientation, const uint8_t *msg, size_t len, color_t color)
+{
+	assert(msg);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+		glLoadIdentity();
+		glTranslatef(x, y, 0.0);
+		glScaled(scale_x, scale_y, 1.0);
+		glRotated(rad2deg(orientation), 0, 0, 1);
+		set_color(color, true);
+		for(size_t i = 0; i < len; i++) {
+			uint8_t c = msg[i];
+			c = c >= 32 && c <= 127 ? c : '?';
+			glutStrokeCharacter(world.font_scaled, c);
+		}
+		glEnd();
+	glPopMatrix();
+	return len;
+}
+
+static int draw_string_scaled(double x, double y, double scale_x, double scale_y, double orientation, const char *msg, color_t color)
+{
+	assert(msg);
+	return draw_block_scaled(x, y, scale_x, scale_y, orientation, (uint8_t*)msg, strlen(msg), color);
+}
+
+static int vdraw_text(color_t color, double x, double y, const char *fmt, va_list ap)
+{
+	char f;
+	int r = 0;
+	assert(fmt);
+	static const double scale_x = 0.011;
+	static const double scale_y = 0.011;
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	set_color(color, true);
+	glTranslatef(x, y, 0);
+	glScaled(scale_x, scale_y, 1.0);
+	while(*fmt) {
+		if('%' != (f = *fmt++)) {
+			glutStrokeCharacter(world.font_scaled, f);
+			r++;
+			continue;
+		}
+		switch(f = *fmt++) {
+		case 'c':
+		{
+			char x[2] = {0, 0};
+			x[0] = va_arg(ap, int);
+			r += draw_string(x);
+			break;
+		}
+		case 's':
+		{
+			char *s = va_arg(ap, char*);
+			r += draw_string(s);
+			break;
+		}
+		case 'x':
+		{
+			unsigned d = va_arg(ap, unsigned);
+			char s[64] = {0};
+			sprintf(s, "%04x", d);
+			r += draw_string(s);
+			break;
+		}
+		case 'u':
+		case 'd':
+		{
+			int d = va_arg(ap, int);
+			char s[64] = {0};
+			sprintf(s, f == 'u' ? "%u": "%d", d);
+			r += draw_string(s);
+			break;
+		}
+		case 'f':
+		{
+			double f = va_arg(ap, double);
+			char s[512] = {0};
+			sprintf(s, "%.2f", f);
+			r += draw_string(s);
+			break;
+		}
+		case 0:
+		default:
+			fatal("invalid format specifier '%c'", f);
+		}
+
+	}
+	glPopMatrix();
+	return r;
+}
+
+static void fill_textbox(textbox_t *t, const char *fmt, ...)
+{
+	double r;
+	va_list ap;
+	assert(t);
+	assert(fmt);
+
+	scale_t scale = font_attributes();
+	double char_width = scale.x / X_MAX;
+	double char_height = scale.y / Y_MAX;
+	assert(t && fmt);
+	va_start(ap, fmt);
+	r = vdraw_text(t->color_text, t->x, t->y - t->height, fmt, ap);
+	r *= char_width * 1.11;
+	r += 1;
+	va_end(ap);
+	t->width = MAX(t->width, r);
+	t->height += (char_height); /*correct?*/
+}
+
+/*static void draw_textbox(textbox_t *t)
+{
+	assert(t);
+	scale_t scale = font_attributes();
+	double char_height = scale.y / Y_MAX;
+	if(!(t->draw_border))
+		return;
+	draw_rectangle_line(t->x - LINE_WIDTH, t->y - t->height + char_height - 1, t->width, t->height + 1, LINE_WIDTH, t->color_box);
+}*/
+
+/* ====================================== Frame Statistics ===================================== */
+
+/* What went into each frame is gathered as it happens: the time spent
+ * parsing and the bytes parsed on the ticks since the last frame, then the
+ * time spent drawing it, the cells whose geometry was built and the number
+ * of buffer and texture uploads. The render time is how long it took to
+ * hand the frame to GL, not how long the GPU took over it. */
+
+#define FRAME_BUCKETS   (16)  /* the last bucket holds everything slower */
+#define FRAME_BUCKET_MS (2.0)
+
+typedef struct {
+	double parse, render; /* seconds */
+	size_t bytes, cells, uploads;
+} frame_t;
+
+typedef struct {
+	const char *name;
+	uint64_t count[FRAME_BUCKETS];
+	double total, worst; /* milliseconds */
+} histogram_t;
+
+typedef struct {
+	frame_t current; /* being gathered */
+	frame_t last;    /* the last frame drawn */
+	frame_t total;
+	uint64_t frames;
+	double started;  /* when the first frame was drawn */
+	histogram_t parse, render;
+} frame_statistics_t;
+
+static frame_statistics_t frame_statistics = {
+	.parse  = { .name = "parse" },
+	.render = { .name = "render" },
+};
+
+static void histogram_add(histogram_t *h, double ms)
+{
+	assert(h);
+	const size_t bucket = ms / FRAME_BUCKET_MS;
+	h->count[MIN(bucket, (size_t)FRAME_BUCKETS - 1)]++;
+	h->total += ms;
+	h->worst = MAX(h->worst, ms);
+}
+
+/**@brief close off the frame being gathered once it has been drawn */
+static void frame_end(frame_statistics_t *f)
+{
+	assert(f);
+	if(!(f->frames))
+		f->started = seconds();
+	f->frames++;
+	histogram_add(&f->parse,  f->current.parse  * 1000.0);
+	histogram_add(&f->render, f->current.render * 1000.0);
+	f->total.parse   += f->current.parse;
+	f->total.render  += f->current.render;
+	f->total.bytes   += f->current.bytes;
+	f->total.cells   += f->current.cells;
+	f->total.uploads += f->current.uploads;
+	f->last = f->current;
+	memset(&f->current, 0, sizeof(f->current));
+}
+
+static void draw_frame_statistics(const frame_statistics_t *f, double x, double y)
+{
+	assert(f);
+	textbox_t t = { .x = x, .y = y, .color_text = YELLOW };
+	const double elapsed = seconds() - f->started;
+	glPushAttrib(GL_ENABLE_BIT);
+	glDisable(GL_DEPTH_TEST); /* drawn over the terminal */
+	fill_textbox(&t, "frames %u, %f fps", (unsigned)f->frames, elapsed > 0. ? f->frames / elapsed : 0.);
+	fill_textbox(&t, "parse  %f ms, %u bytes", f->last.parse * 1000.0, (unsigned)f->last.bytes);
+	fill_textbox(&t, "render %f ms, %u cells", f->last.render * 1000.0, (unsigned)f->last.cells);
+	fill_textbox(&t, "uploads %u", (unsigned)f->last.uploads);
+	const histogram_t *hs[] = { &f->parse, &f->render };
+	for(size_t i = 0; i < 2; i++)
+		fill_textbox(&t, "%s worst %f ms, mean %f ms", hs[i]->name, hs[i]->worst, f->frames ? hs[i]->total / f->frames : 0.);
+	glPopAttrib();
+}
+
+static void dump_frame_statistics(const frame_statistics_t *f)
+{
+	assert(f);
+	if(!(f->frames))
+		return;
+	const double n = f->frames;
+	note("%"PRIu64" frames, %.2f fps", f->frames, n / MAX(seconds() - f->started, 1e-9));
+	note("per frame: %.0f bytes parsed, %.0f cells built, %.2f uploads",
+			f->total.bytes / n, f->total.cells / n, f->total.uploads / n);
+	const histogram_t *hs[] = { &f->parse, &f->render };
+	for(size_t i = 0; i < 2; i++) {
+		const histogram_t *h = hs[i];
+		note("%s: mean %.3f ms, worst %.3f ms", h->name, h->total / n, h->worst);
+		for(size_t j = 0; j < FRAME_BUCKETS; j++)
+			if(h->count[j])
+				note("%s: %s %5.1f ms %8"PRIu64" %5.1f%%", h->name, j == FRAME_BUCKETS - 1 ? ">=" : "< ",
+					(j + (j != FRAME_BUCKETS - 1)) * FRAME_BUCKET_MS, h->count[j], (h->count[j] * 100.0) / n);
+	}
+}
+
+/* ====================================== Frame Statistics ===================================== */
+
+/* ====================================== Simulator Objects ==================================== */
+
+/**@brief the background colors of a terminal as a texture with a texel per
+ * cell, the texture itself is rounded up to a power of two in size */
+typedef struct {
+	unsigned width;  /* in cells */
+	unsigned height;
+	unsigned texture_width;
+	unsigned texture_height;
+	GLuint name;
+	uint8_t *image;  /* RGBA, width * height texels */
+} vt100_background_texture_t;
+
+typedef struct {
+	uint64_t blink_count;
+	double x;
+	double y;
+	size_t scroll; /* lines scrolled back into the history */
+	bool blink_on;
+	bool batched;  /* drawn from the glyph atlas, background included */
+	size_t cursor_drawn;   /* the cursor as of the last frame, moving it is */
+	bool cursor_on_drawn;  /* not damage to the vt100 but needs a redraw */
+	color_t color;
+	vt100_t *vt100;
+	vt100_background_texture_t *texture;
+} terminal_t;
+
+/* The glyph atlas: the stroke font is drawn once into the frame buffer and
+ * copied into a texture, a cell per character. The geometry for the whole
+ * terminal, a background quad and a glyph quad per cell and a quad for the
+ * cursor, is kept in one vertex buffer object laid out as:
+ *
+ *	[ backgrounds: size * 4 ][ glyphs: size * 4 ][ cursor: 4 ]
+ *
+ * Only the rows the emulator reports as dirty are rebuilt and uploaded, the
+ * lot is then drawn with three draw calls. Blank cells get an empty glyph
+ * quad so every cell keeps the same place in the buffer. */
+
+#define ATLAS_COLUMNS     (16)
+#define ATLAS_ROWS        (8)
+#define ATLAS_CELL_WIDTH  (16)
+#define ATLAS_CELL_HEIGHT (32)
+#define ATLAS_WIDTH       (ATLAS_COLUMNS * ATLAS_CELL_WIDTH)
+#define ATLAS_HEIGHT      (ATLAS_ROWS * ATLAS_CELL_HEIGHT)
+#define ATLAS_DESCENT     (33.33) /* below the base line, in stroke font units */
+
+typedef struct {
+	GLfloat s, t;
+	GLubyte r, g, b, a;
+	GLfloat x, y, z;
+} atlas_vertex_t; /* matches GL_T2F_C4UB_V3F */
+
+typedef struct {
+	GLuint name;          /* texture holding the glyphs */
+	GLuint buffer;        /* vertex buffer, zero if not supported */
+	double width, height; /* of a glyph cell in stroke font units */
+	atlas_vertex_t *vertices; /* copy of what is in the vertex buffer */
+	size_t capacity;      /* in vertices */
+	unsigned columns, rows;   /* terminal size the vertices were built for */
+	size_t scroll;        /* and how far it was scrolled back */
+	bool blink;           /* and the blink state */
+} glyph_atlas_t;
+
+static glyph_atlas_t glyph_atlas = { .name = 0 };
+
+static bool atlas_build(glyph_atlas_t *a)
+{
+	assert(a);
+	if(a->name)
+		return true;
+	if(world.window_width < ATLAS_WIDTH || world.window_height < ATLAS_HEIGHT)
+		return false;
+
+	scale_t scale = font_attributes();
+	a->width  = scale.x;
+	a->height = scale.y + ATLAS_DESCENT;
+
+	glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_LINE_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glViewport(0, 0, ATLAS_WIDTH, ATLAS_HEIGHT);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, ATLAS_WIDTH, 0, ATLAS_HEIGHT, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glColor3f(1.0, 1.0, 1.0);
+	glLineWidth(1.5);
+	for(unsigned c = 32; c < 128; c++) {
+		glLoadIdentity();
+		glTranslated((c % ATLAS_COLUMNS) * ATLAS_CELL_WIDTH, (c / ATLAS_COLUMNS) * ATLAS_CELL_HEIGHT, 0.0);
+		glScaled(ATLAS_CELL_WIDTH / a->width, ATLAS_CELL_HEIGHT / a->height, 1.0);
+		glTranslated(0.0, ATLAS_DESCENT, 0.0);
+		glutStrokeCharacter(world.font_scaled, c);
+	}
+
+	glGenTextures(1, &a->name);
+	glBindTexture(GL_TEXTURE_2D, a->name);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_INTENSITY, 0, 0, ATLAS_WIDTH, ATLAS_HEIGHT, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+
+	const char *version = (const char*)glGetString(GL_VERSION);
+	unsigned major = 0, minor = 0;
+	if(version && sscanf(version, "%u.%u", &major, &minor) == 2 && (major > 1 || minor >= 5))
+		glGenBuffers(1, &a->buffer);
+	else
+		note("no vertex buffer objects, drawing from client memory");
+	debug("glyph atlas built");
+	return true;
+}
+
+static void atlas_quad(atlas_vertex_t *v, double x, double y, double width, double height, uint8_t c, const double rgb[3])
+{
+	const GLfloat s0 = (GLfloat)(c % ATLAS_COLUMNS) / ATLAS_COLUMNS;
+	const GLfloat t0 = (GLfloat)(c / ATLAS_COLUMNS) / ATLAS_ROWS;
+	const GLfloat s1 = s0 + (1.0f / ATLAS_COLUMNS);
+	const GLfloat t1 = t0 + (1.0f / ATLAS_ROWS);
+	const GLfloat xs[] = { x, x + width, x + width, x };
+	const GLfloat ys[] = { y, y, y + height, y + height };
+	const GLfloat ss[] = { s0, s1, s1, s0 };
+	const GLfloat ts[] = { t0, t0, t1, t1 };
+	for(size_t i = 0; i < 4; i++) {
+		v[i].s = ss[i];
+		v[i].t = ts[i];
+		v[i].r = rgb[0] * 255.0;
+		v[i].g = rgb[1] * 255.0;
+		v[i].b = rgb[2] * 255.0;
+		v[i].a = 255;
+		v[i].x = xs[i];
+		v[i].y = ys[i];
+		v[i].z = 0.0;
+	}
+}
+
+/**@brief does a row of the display have any blinking cells in it */
+static bool terminal_row_blinks(const terminal_t *t, unsigned y)
+{
+	assert(t);
+	const uint8_t *m = NULL;
+	const vt100_attribute_t *a = NULL;
+	vt100_row(t->vt100, t->scroll, y, &m, &a);
+	for(unsigned x = 0; x < t->vt100->width; x++)
+		if(vt100_flag(a[x], VT100_BLINK))
+			return true;
+	return false;
+}
+
+/**@brief rebuild the background and glyph quads for one row of the display */
+static void atlas_row(glyph_atlas_t *a, const terminal_t *t, unsigned i, double scale_x, double scale_y, bool blink)
+{
+	vt100_t *v = t->vt100;
+	const uint8_t *m = NULL;
+	const vt100_attribute_t *attr = NULL;
+	scale_t scale = font_attributes();
+	const double char_width  = (scale.x / X_MAX) * 1.1;
+	const double char_height = scale.y / Y_MAX;
+	const double width = a->width * scale_x, height = a->height * scale_y;
+	const double y = t->y - (char_height * i);
+	atlas_vertex_t *background = &a->vertices[(i * v->width) * 4];
+	atlas_vertex_t *glyph      = &a->vertices[(v->size + (i * v->width)) * 4];
+
+	vt100_row(v, t->scroll, i, &m, &attr);
+	frame_statistics.current.cells += v->width;
+	for(unsigned j = 0; j < v->width; j++) {
+		const double x = t->x + (char_width * j);
+		double rgb[3];
+		color_rgb(vt100_background(attr[j]), true, rgb);
+		atlas_quad(&background[j * 4], x, y, char_width, char_height, ' ', rgb);
+
+		uint8_t c = vt100_flag(attr[j], VT100_CONCEAL) ? '*' : m[j];
+		const bool hidden = c == ' ' || (blink && vt100_flag(attr[j], VT100_BLINK));
+		c = c >= 32 && c <= 127 ? c : '?';
+		color_rgb(vt100_foreground(attr[j]), vt100_flag(attr[j], VT100_BOLD), rgb);
+		atlas_quad(&glyph[j * 4], x, y - (ATLAS_DESCENT * scale_y), hidden ? 0.0 : width, hidden ? 0.0 : height, c, rgb);
+	}
+}
+
+static void atlas_upload(const glyph_atlas_t *a, size_t first, size_t count)
+{
+	if(a->buffer && count) {
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(a->vertices[0]), count * sizeof(a->vertices[0]), &a->vertices[first]);
+		frame_statistics.current.uploads++;
+	}
+}
+
+/**@brief draw a terminal, its background and cursor from the glyph atlas,
+ * laid out as draw_vt100_block() lays it out, returns false if there is no
+ * atlas to draw with */
+static bool draw_vt100_atlas(terminal_t *t, double scale_x, double scale_y, bool blink, bool cursor)
+{
+	assert(t);
+	glyph_atlas_t *a = &glyph_atlas;
+	const vt100_t *v = t->vt100;
+	if(!atlas_build(a))
+		return false;
+
+	const size_t needed = (v->size * 8) + 4;
+	const bool rebuild = a->capacity != needed
+		|| a->columns != v->width || a->rows != v->height
+		|| a->scroll || a->scroll != t->scroll;
+	const bool blinked = a->blink != blink; /* only rows with blinking cells change */
+	if(a->capacity != needed) {
+		free(a->vertices);
+		a->vertices = allocate_or_die(needed * sizeof(a->vertices[0]));
+		a->capacity = needed;
+	}
+	a->columns = v->width;
+	a->rows    = v->height;
+	a->scroll  = t->scroll;
+	a->blink   = blink;
+
+	if(a->buffer)
+		glBindBuffer(GL_ARRAY_BUFFER, a->buffer);
+	for(unsigned i = 0; i < v->height;) { /* upload runs of dirty rows */
+		unsigned j = i;
+		for(; j < v->height && (rebuild || vt100_row_dirty(v, j) || (blinked && terminal_row_blinks(t, j))); j++)
+			atlas_row(a, t, j, scale_x, scale_y, blink);
+		if(!rebuild && j > i) {
+			atlas_upload(a, i * v->width * 4, (j - i) * v->width * 4);
+			atlas_upload(a, (v->size + (i * v->width)) * 4, (j - i) * v->width * 4);
+		}
+		i = j + 1;
+	}
+
+	scale_t scale = font_attributes();
+	const double char_width  = scale.x / X_MAX;
+	const double char_height = scale.y / Y_MAX;
+	static const double white[3] = { 0.8, 0.8, 0.8 };
+	atlas_vertex_t *c = &a->vertices[v->size * 8];
+	atlas_quad(c,
+		t->x + (char_width * 1.10 * (v->cursor % v->width)), t->y - (char_height * (v->cursor / v->width)),
+		cursor ? char_width : 0.0, cursor ? char_height : 0.0, ' ', white);
+	if(rebuild && a->buffer) {
+		glBufferData(GL_ARRAY_BUFFER, needed * sizeof(a->vertices[0]), a->vertices, GL_DYNAMIC_DRAW);
+		frame_statistics.current.uploads++;
+	} else
+		atlas_upload(a, v->size * 8, 4);
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glPushAttrib(GL_ENABLE_BIT);
+	glDisable(GL_DEPTH_TEST); /* drawn in order, backgrounds first */
+	glInterleavedArrays(GL_T2F_C4UB_V3F, 0, a->buffer ? NULL : a->vertices);
+	glDrawArrays(GL_QUADS, 0, v->size * 4);
+
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, a->name);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glEnable(GL_ALPHA_TEST); /* so the empty parts of a glyph do not hide the background */
+	glAlphaFunc(GL_GREATER, 0.25);
+	glDrawArrays(GL_QUADS, v->size * 4, v->size * 4);
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_TEXTURE_2D);
+
+	glDrawArrays(GL_QUADS, v->size * 8, 4);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	if(a->buffer)
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glPopAttrib();
+	glPopMatrix();
+	return true;
+}
+
+/**@brief fill in the texels for a row of the display */
+static void texture_background(terminal_t *t, unsigned i)
+{
+	assert(t);
+	vt100_background_texture_t *v = t->texture;
+	const uint8_t *m = NULL;
+	const vt100_attribute_t *a = NULL;
+	uint8_t *row = &v->image[i * v->width * 4];
+	assert(i < v->height);
+
+	vt100_row(t->vt100, t->scroll, i, &m, &a);
+	for(unsigned j = 0; j < v->width; j++) {
+		double rgb[3];
+		color_rgb(vt100_background(a[j]), true, rgb);
+		row[(j * 4) + 0] = rgb[0] * 255.0;
+		row[(j * 4) + 1] = rgb[1] * 255.0;
+		row[(j * 4) + 2] = rgb[2] * 255.0;
+		row[(j * 4) + 3] = 255;
+	}
+}
+
+static unsigned power_of_two(unsigned n)
+{
+	unsigned r = 1;
+	while(r < n)
+		r <<= 1;
+	return r;
+}
+
+/* See <http://www.glprogramming.com/red/chapter09.html> */
+static void draw_texture(terminal_t *t)
+{
+	vt100_background_texture_t *v = t->texture;
+	vt100_t *vt = t->vt100;
+	if(!v)
+		return;
+
+	scale_t scale = font_attributes();
+	double char_width  = scale.x / X_MAX;
+       	double char_height = scale.y / Y_MAX;
+	double x = t->x;
+	double y = t->y - (char_height * (vt->height-1.0));
+	double width  = char_width  * vt->width * 1.10;
+	double height = char_height * vt->height;
+	bool all = t->scroll != 0; /* damage is relative to the live display */
+
+	glEnable(GL_TEXTURE_2D);
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
+
+	if(!(v->name))
+		glGenTextures(1, &v->name);
+	glBindTexture(GL_TEXTURE_2D, v->name);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if(v->width != vt->width || v->height != vt->height || !(v->image)) {
+		free(v->image);
+		v->width          = vt->width;
+		v->height         = vt->height;
+		v->texture_width  = power_of_two(v->width);
+		v->texture_height = power_of_two(v->height);
+		v->image          = allocate_or_die(v->width * v->height * 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, v->texture_width, v->texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		all = true;
+	}
+
+	for(unsigned i = 0; i < v->height;) { /* upload runs of dirty rows */
+		unsigned j = i;
+		for(; j < v->height && (all || vt100_row_dirty(vt, j)); j++)
+			texture_background(t, j);
+		if(j > i) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i, v->width, j - i, GL_RGBA, GL_UNSIGNED_BYTE, &v->image[i * v->width * 4]);
+			frame_statistics.current.uploads++;
+		}
+		i = j + 1;
+	}
+
+	const GLfloat s1 = (GLfloat)v->width  / v->texture_width;
+	const GLfloat t1 = (GLfloat)v->height / v->texture_height;
+	glMatrixMode(GL_MODELVIEW);
+	glBegin(GL_QUADS); /* texture row zero is the top row of the display */
+		glTexCoord2f(0.0, 0.0); glVertex3f(x,       y+height, 0.0);
+		glTexCoord2f(s1,  0.0); glVertex3f(x+width, y+height, 0.0);
+		glTexCoord2f(s1,  t1);  glVertex3f(x+width, y,        0.0);
+		glTexCoord2f(0.0, t1);  glVertex3f(x,       y,        0.0);
+	glEnd();
+	glDisable(GL_TEXTURE_2D);
+}
+
+/**@brief has the cursor moved, or been shown or hidden, since the last frame */
+static bool terminal_cursor_changed(const terminal_t *t)
+{
+	assert(t);
+	return t->cursor_drawn != t->vt100->cursor || t->cursor_on_drawn != t->vt100->cursor_on;
+}
+
+/**@brief flip the blink state once a second, returns true if the cursor or
+ * any cell on the display blinks and so the terminal needs redrawing */
+static bool terminal_blink(const world_t *world, terminal_t *t)
+{
+	assert(world);
+	assert(t);
+	vt100_t *v = t->vt100;
+	if((world->tick - t->blink_count) <= seconds_to_ticks(world, 1.0))
+		return false;
+	t->blink_on = !(t->blink_on);
+	t->blink_count = world->tick;
+	if(v->blinks && v->cursor_on)
+		return true;
+	for(unsigned i = 0; i < v->height; i++)
+		if(terminal_row_blinks(t, i))
+			return true;
+	return false;
+}
+
+void draw_terminal(const world_t *world, terminal_t *t, char *name)
+{
+	assert(world);
+	assert(t);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+
+	static const double scale_x = 0.011;
+	static const double scale_y = 0.011;
+	vt100_t *v = t->vt100;
+	scale_t scale = font_attributes();
+	double char_width  = scale.x / X_MAX;
+       	double char_height = scale.y / Y_MAX;
+	size_t cursor_x = v->cursor % v->width;
+	size_t cursor_y = v->cursor / v->width;
+	const bool cursor = (!(v->blinks) || t->blink_on) && v->cursor_on && !(t->scroll);
+	t->cursor_drawn    = v->cursor;
+	t->cursor_on_drawn = v->cursor_on;
+
+	t->batched = world->use_glyph_atlas && draw_vt100_atlas(t, scale_x, scale_y, t->blink_on, cursor);
+	if(!(t->batched)) {
+		/**@note the cursor is deliberately in a different position compared to draw_vga(), due to how the VGA cursor behaves in hardware */
+		if(cursor) /* fudge factor of 1.10? */
+			draw_rectangle_filled(t->x + (char_width * 1.10 * (cursor_x)) , t->y - (char_height * cursor_y), char_width, char_height, WHITE);
+
+		for(size_t i = 0; i < v->height; i++) {
+			const uint8_t *m = NULL;
+			const vt100_attribute_t *a = NULL;
+			vt100_row(v, t->scroll, i, &m, &a);
+			draw_vt100_block(t->x, t->y - ((double)i * char_height), scale_x, scale_y, 0, m, v->width, a, t->blink_on);
+		}
+		frame_statistics.current.cells += v->size;
+	}
+	draw_string_scaled(t->x, t->y - (v->height * char_height), scale_x, scale_y, 0, name, t->color);
+
+	/* fudge factor = 1/((1/scale_x)/X_MAX) ??? */
+
+	glPopMatrix();
+
+	draw_rectangle_line(t->x, t->y - (char_height * (v->height-1.0)), char_width * v->width * 1.10, char_height * v->height, LINE_WIDTH, t->color);
+}
+
+/* ====================================== Simulator Objects ==================================== */
+
+/* ====================================== Simulator Instances ================================== */
+
+
+static vt100_background_texture_t vga_background_texture = {
+	.width  = 0, /* sized to the terminal on first use */
+	.height = 0,
+	.name   = 0,
+	.image  = NULL
+};
+
+static terminal_t vga_terminal = {
+	.blink_count = 0,
+	.x           = X_MIN + 2.0,
+	.y           = Y_MAX - 8.0,
+	.color       = GREEN,  /* WHITE */
+	.blink_on    = false,
+	.vt100       = NULL, /* allocated in main() */
+	.texture     = &vga_background_texture
+};
+
+
+static pty_t *pty = NULL; /* NULL when echoing keys locally */
+
+/* ====================================== Simulator Instances ================================== */
+
+/* ====================================== Main Loop ============================================ */
+
+static void keyboard_handler(unsigned char key, int x, int y)
+{
+	UNUSED(x);
+	UNUSED(y);
+	world.redraw = true;
+	if(vga_terminal.scroll)
+		vt100_damage_all(vga_terminal.vt100);
+	vga_terminal.scroll = 0;
+	if(pty) { /* the shell exiting ends the program, not escape */
+		const uint8_t c = key == BACKSPACE ? DELETE : key;
+		pty_write(pty, &c, 1);
+	} else if(key == ESCAPE) {
+		world.halt_simulation = true;
+	} else {
+		vt100_update(vga_terminal.vt100, key);
+		if(key == '\r')
+			vt100_update(vga_terminal.vt100, '\n');
+	}
+}
+
+static void keyboard_special_handler(int key, int x, int y)
+{
+	UNUSED(x);
+	UNUSED(y);
+	world.redraw = true;
+	switch(key) {
+	case GLUT_KEY_F1: /* switch between the glyph atlas and stroke characters */
+		world.use_glyph_atlas = !(world.use_glyph_atlas);
+		vt100_damage_all(vga_terminal.vt100);
+		return;
+	case GLUT_KEY_F2:
+		world.show_statistics = !(world.show_statistics);
+		return;
+	case GLUT_KEY_PAGE_UP:
+		vga_terminal.scroll = MIN(vga_terminal.scroll + (vga_terminal.vt100->height / 2), vga_terminal.vt100->scrollback.count);
+		vt100_damage_all(vga_terminal.vt100);
+		return;
+	case GLUT_KEY_PAGE_DOWN:
+		vga_terminal.scroll -= MIN(vga_terminal.scroll, vga_terminal.vt100->height / 2);
+		vt100_damage_all(vga_terminal.vt100);
+		return;
+	}
+	if(pty) {
+		static const char arrows[] = { 'D', 'A', 'C', 'B' };
+		if(key >= GLUT_KEY_LEFT && key <= GLUT_KEY_DOWN) { /* application cursor keys (DECCKM) use SS3 */
+			const uint8_t arrow[] = { ESCAPE, vga_terminal.vt100->cursor_keys ? 'O' : '[', arrows[key - GLUT_KEY_LEFT] };
+			pty_write(pty, arrow, sizeof(arrow));
+		}
+		return;
+	}
+	vt100_update(vga_terminal.vt100, key);
+	switch(key) {
+	case GLUT_KEY_UP:    
+	case GLUT_KEY_LEFT:  
+	case GLUT_KEY_RIGHT: 
+	case GLUT_KEY_DOWN:  
+	case GLUT_KEY_F1:   
+	case GLUT_KEY_F2:  
+	case GLUT_KEY_F3: 
+	case GLUT_KEY_F4:  
+	case GLUT_KEY_F5:  
+	case GLUT_KEY_F6:  
+	case GLUT_KEY_F7:  
+	case GLUT_KEY_F8:  
+	case GLUT_KEY_F9:  
+	case GLUT_KEY_F10: 
+	case GLUT_KEY_F11: 
+	case GLUT_KEY_F12: 
+	default:
+		break;
+	}
+}
+
+static void keyboard_special_up_handler(int key, int x, int y)
+{
+	UNUSED(x);
+	UNUSED(y);
+	switch(key) {
+	case GLUT_KEY_UP:   
+	case GLUT_KEY_LEFT: 
+	case GLUT_KEY_RIGHT:
+	case GLUT_KEY_DOWN: 
+	default:
+		break;
+	}
+}
+
+typedef struct {
+	double x;
+	double y;
+} coordinate_t;
+
+/**@brief resize the emulator, and the program on the pseudo terminal, to
+ * as many rows and columns as fit in the visible part of the world, the
+ * characters stay the same size in world coordinates */
+static void terminal_fit(terminal_t *t, double x_max, double y_min)
+{
+	assert(t);
+	if(!(t->vt100))
+		return;
+	const scale_t scale = font_attributes();
+	const double char_width  = (scale.x / X_MAX) * 1.10;
+	const double char_height = scale.y / Y_MAX;
+	const double columns = floor((x_max - t->x - 2.0) / char_width);    /* a margin to the right */
+	const double rows    = floor((t->y - y_min) / char_height) - 2.0; /* the name and a margin below */
+	const unsigned width = MAX(columns, 1.0), height = MAX(rows, 1.0);
+	if(width == t->vt100->width && height == t->vt100->height)
+		return;
+	vt100_resize(t->vt100, width, height);
+	if(pty)
+		pty_resize(pty, width, height);
+	t->scroll = MIN(t->scroll, t->vt100->scrollback.count);
+}
+
+static void resize_window(int w, int h)
+{
+	double window_x_min, window_x_max, window_y_min, window_y_max;
+	double scale, center;
+	world.window_width  = w;
+	world.window_height = h;
+
+	glViewport(0, 0, w, h);
+
+	w = (w == 0) ? 1 : w;
+	h = (h == 0) ? 1 : h;
+	if ((X_MAX - X_MIN) / w < (Y_MAX - Y_MIN) / h) {
+		scale = ((Y_MAX - Y_MIN) / h) / ((X_MAX - X_MIN) / w);
+		center = (X_MAX + X_MIN) / 2;
+		window_x_min = center - (center - X_MIN) * scale;
+		window_x_max = center + (X_MAX - center) * scale;
+		world.window_scale_x = scale;
+		window_y_min = Y_MIN;
+		window_y_max = Y_MAX;
+	} else {
+		scale = ((X_MAX - X_MIN) / w) / ((Y_MAX - Y_MIN) / h);
+		center = (Y_MAX + Y_MIN) / 2;
+		window_y_min = center - (center - Y_MIN) * scale;
+		window_y_max = center + (Y_MAX - center) * scale;
+		world.window_scale_y = scale;
+		window_x_min = X_MIN;
+		window_x_max = X_MAX;
+	}
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(window_x_min, window_x_max, window_y_min, window_y_max, -1, 1);
+	terminal_fit(&vga_terminal, window_x_max, window_y_min);
+}
+
+static void mouse_handler(int button, int state, int x, int y)
+{
+	UNUSED(button);
+	UNUSED(state);
+	UNUSED(x);
+	UNUSED(y);
+}
+
+/**@note nothing is drawn unless the emulator reports damage, something
+ * blinks, or there was input, and then at most once a tick, GLUT will also
+ * redraw when the window is exposed or resized */
+/* Each tick parses as much of the shell's output as fits in the parse
+ * budget and then draws once, so a flood of output is worked through at
+ * full speed while the display still refreshes at a steady rate. The next
+ * tick is brought forward by the time spent parsing. When parsing falls
+ * behind the FIFO fills up and the reader stops reading the PTY, which
+ * blocks the child until there is room. */
+static void timer_callback(int value)
+{
+	const double start = seconds();
+	world.tick++;
+	if(pty) {
+		frame_statistics.current.bytes += pty_drain(pty, vga_terminal.vt100, world.parse_budget);
+		frame_statistics.current.parse += seconds() - start;
+		if(pty->closed)
+			world.halt_simulation = true;
+	}
+	if(terminal_blink(&world, &vga_terminal) || terminal_cursor_changed(&vga_terminal))
+		world.redraw = true;
+	if(world.redraw || world.halt_simulation || world.show_statistics || vt100_damaged(vga_terminal.vt100, NULL)) {
+		world.redraw = false;
+		glutPostRedisplay();
+	}
+	const double spent = (seconds() - start) * 1000.0;
+	glutTimerFunc(world.arena_tick_ms - (unsigned)MIN(spent, world.arena_tick_ms - 1.0), timer_callback, value);
+}
+
+static void draw_scene(void)
+{
+	if(world.halt_simulation)
+		exit(EXIT_SUCCESS);
+
+	const double start = seconds();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	draw_terminal(&world, &vga_terminal, "VT100");
+	if(!(vga_terminal.batched))
+		draw_texture(&vga_terminal);
+	vt100_damage_clear(vga_terminal.vt100);
+	if(world.show_statistics)
+		draw_frame_statistics(&frame_statistics, X_MAX - 40.0, Y_MAX - 2.0);
+
+	glFlush();
+	glutSwapBuffers();
+	frame_statistics.current.render = seconds() - start;
+	frame_end(&frame_statistics);
+}
+
+static void initialize_rendering(char *arg_0)
+{
+	char *glut_argv[] = { arg_0, NULL };
+	int glut_argc = 0;
+	glutInit(&glut_argc, glut_argv);
+	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH );
+	glutInitWindowPosition(world.window_x_starting_position, world.window_y_starting_position);
+	glutInitWindowSize(world.window_width, world.window_height);
+	glutCreateWindow("VT100 Terminal Emulator");
+	glShadeModel(GL_FLAT);
+	glEnable(GL_DEPTH_TEST);
+	glutKeyboardFunc(keyboard_handler);
+	glutSpecialFunc(keyboard_special_handler);
+	glutSpecialUpFunc(keyboard_special_up_handler);
+	glutMouseFunc(mouse_handler);
+	glutReshapeFunc(resize_window);
+	glutDisplayFunc(draw_scene);
+	glutTimerFunc(world.arena_tick_ms, timer_callback, 0);
+}
+
+static void finalize(void)
+{
+	dump_frame_statistics(&frame_statistics);
+	free(glyph_atlas.vertices); /* the GL objects go with the context */
+	free(vga_background_texture.image);
+	pty_free(pty);
+	vt100_free(vga_terminal.vt100);
+}
+
+int main(int argc, char **argv)
+{
+	assert(Y_MAX > 0. && Y_MIN < Y_MAX && Y_MIN >= 0.);
+	assert(X_MAX > 0. && X_MIN < X_MAX && X_MIN >= 0.);
+
+	log_level = LOG_NOTE;
+
+	vga_terminal.vt100 = vt100_new(VGA_WIDTH, VGA_HEIGHT, VT100_SCROLLBACK_LINES);
+
+	bool local = false;
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-l")) /* echo keys locally, no shell */
+			local = true;
+		else if(!strcmp(argv[i], "-s") && (i + 1) < argc) /* a far deeper scrollback, kept in a file */
+			vt100_scrollback_file(vga_terminal.vt100, argv[++i], VT100_SCROLLBACK_FILE_LINES);
+		else
+			fatal("usage: %s [-l] [-s scrollback-file]", argv[0]);
+	}
+
+	if(!local) {
+		const char *shell = getenv("SHELL");
+		pty = pty_new(shell ? shell : "/bin/sh", VGA_WIDTH, VGA_HEIGHT);
+	}
+
+	atexit(finalize);
+	initialize_rendering(argv[0]);
+	glutMainLoop();
+
+	return 0;
+}
+
+
@@ -1,162 +1,30 @@
-/**@file      gui.c
- * @brief     Simulate the H2 SoC peripherals visually
+/**@file      vt100.c
+ * @brief     VT100 terminal state machine and screen model, the FIFO and
+ *            the pseudo terminal, built without any graphics library
  * @copyright Richard James Howe (2017)
  * @license   MIT */
 
+#define _XOPEN_SOURCE 600 /* for posix_openpt() and friends */
+
+#include "vt100.h"
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
-#include <inttypes.h>
-#include <math.h>
 #include <stdarg.h>
-#include <stdbool.h>
-#include <stdbool.h>
-#include <stddef.h>
-#include <stdint.h>
-#include <stdint.h>
-#include <stdio.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <GL/gl.h>
-#include <GL/glut.h>
-#include <GL/freeglut_ext.h> /* for glutStrokeHeight */
-
-#define VGA_BUFFER_LENGTH          (1 << 13)
-#define VGA_WIDTH                  (80)
-#define VGA_HEIGHT                 (40)
-#define VGA_AREA                   (VGA_WIDTH * VGA_HEIGHT)
-
-#define VGA_CTL_B_BIT              (0)
-#define VGA_CTL_G_BIT              (1)
-#define VGA_CTL_R_BIT              (2)
-#define VGA_CUR_MODE_BIT           (3)
-#define VGA_CUR_BLINK_BIT          (4)
-#define VGA_CUR_EN_BIT             (5)
-#define VGA_EN_BIT                 (6)
-#define VGA_SCREEN_SELECT_BIT      (7)
-
-#define VGA_CTL_B                  (1 << VGA_CTL_B_BIT)
-#define VGA_CTL_G                  (1 << VGA_CTL_G_BIT)
-#define VGA_CTL_R                  (1 << VGA_CTL_R_BIT)
-#define VGA_CUR_MODE               (1 << VGA_CUR_MODE_BIT)
-#define VGA_CUR_BLINK              (1 << VGA_CUR_BLINK_BIT)
-#define VGA_CUR_EN                 (1 << VGA_CUR_EN_BIT)
-#define VGA_EN                     (1 << VGA_EN_BIT)
-#define VGA_SCREEN_SELECT          (1 << VGA_SCREEN_SELECT_BIT)
-
-#define UART_FIFO_DEPTH            (8)
-
-typedef enum { /**@warning do not change the order or insert elements */
-	BLACK,
-	RED,
-	GREEN,
-	YELLOW,
-	BLUE,
-	MAGENTA,
-	CYAN,
-	WHITE,
-} color_t;
-
-typedef enum {
-	TERMINAL_NORMAL_MODE,
-	TERMINAL_CSI,
-	TERMINAL_COMMAND,
-	TERMINAL_NUMBER_1,
-	TERMINAL_NUMBER_2,
-	TERMINAL_DECTCEM,
-	TERMINAL_STATE_END,
-} terminal_state_t;
-
-typedef struct {
-	unsigned bold:          1;
-	unsigned under_score:   1;
-	unsigned blink:         1;
-	unsigned reverse_video: 1;
-	unsigned conceal:       1;
-	unsigned foreground_color: 3;
-	unsigned background_color: 3;
-} vt100_attribute_t;
-
-#define VT100_MAX_SIZE (8192)
-
-typedef struct {
-	size_t cursor;
-	size_t cursor_saved;
-	unsigned n1, n2;
-	unsigned height;
-	unsigned width;
-	unsigned size;
-	terminal_state_t state;
-	bool blinks;
-	bool cursor_on;
-	vt100_attribute_t attribute;
-	vt100_attribute_t attributes[VT100_MAX_SIZE];
-	uint8_t m[VT100_MAX_SIZE];
-	uint8_t command_index;
-} vt100_t;
-
-void *allocate_or_die(size_t length);
-FILE *fopen_or_die(const char *file, const char *mode);
-
-
-typedef uint8_t fifo_data_t;
-
-typedef struct {
-	size_t head;
-	size_t tail;
-	size_t size;
-	fifo_data_t *buffer;
-} fifo_t;
-
-/** @warning LOG_FATAL level kills the program */
-#define X_MACRO_LOGGING\
-	X(LOG_MESSAGE_OFF,  "")\
-	X(LOG_FATAL,        "fatal")\
-	X(LOG_ERROR,        "error")\
-	X(LOG_WARNING,      "warning")\
-	X(LOG_NOTE,         "note")\
-	X(LOG_DEBUG,        "debug")\
-	X(LOG_ALL_MESSAGES, "any")
-
-typedef enum {
-#define X(ENUM, NAME) ENUM,
-	X_MACRO_LOGGING
-#undef X
-} log_level_e;
-
-int logger(log_level_e level, const char *func, const unsigned line, const char *fmt, ...);
-
-#define fatal(FMT, ...)   logger(LOG_FATAL,   __func__, __LINE__, FMT, ##__VA_ARGS__)
-#define error(FMT, ...)   logger(LOG_ERROR,   __func__, __LINE__, FMT, ##__VA_ARGS__)
-#define warning(FMT, ...) logger(LOG_WARNING, __func__, __LINE__, FMT, ##__VA_ARGS__)
-#define note(FMT, ...)    logger(LOG_NOTE,    __func__, __LINE__, FMT, ##__VA_ARGS__)
-#define debug(FMT, ...)   logger(LOG_DEBUG,   __func__, __LINE__, FMT, ##__VA_ARGS__)
-#define BACKSPACE (8)
-#define ESCAPE    (27)
-#define DELETE    (127)  /* ASCII delete */
-
-void vt100_update(vt100_t *t, uint8_t c);
-
-/* ====================================== Utility Functions ==================================== */
-
-#define PI               (3.1415926535897932384626433832795)
-#define MAX(X, Y)        ((X) > (Y) ? (X) : (Y))
-#define MIN(X, Y)        ((X) < (Y) ? (X) : (Y))
-#define UNUSED(X)        ((void)(X))
-#define X_MAX            (100.0)
-#define X_MIN            (0.0)
-#define Y_MAX            (100.0)
-#define Y_MIN            (0.0)
-#define LINE_WIDTH       (0.5)
-#define CYCLE_MODE_FIXED (false)
-#define CYCLE_INITIAL    (100000)
-#define CYCLE_INCREMENT  (10000)
-#define CYCLE_DECREMENT  (500)
-#define CYCLE_MINIMUM    (10000)
-#define CYCLE_HYSTERESIS (2.0)
-#define TARGET_FPS       (30.0)
-#define BACKGROUND_ON    (false)
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TERMINAL_SCAN_X86 (1)
+#include <immintrin.h>
+#endif
 
 
 static const char *log_levels[] =
@@ -166,7 +34,7 @@ static const char *log_levels[] =
 #undef X
 };
 
-static log_level_e log_level = LOG_WARNING;
+log_level_e log_level = LOG_WARNING;
 
 /* ========================== Preamble: Types, Macros, Globals ============= */
 
@@ -228,83 +96,6 @@ FILE *fopen_or_die(const char *file, const char *mode)
 				file, mode, reason());
 	return f;
 }
-
-typedef struct {
-	double window_height;
-	double window_width;
-	double window_x_starting_position;
-	double window_y_starting_position;
-	double window_scale_x;
-	double window_scale_y;
-	volatile unsigned tick;
-	volatile bool     halt_simulation;
-	unsigned arena_tick_ms;
-	bool use_uart_input;
-	bool debug_extra;
-	bool step;
-	bool debug_mode;
-	uint64_t cycle_count;
-	uint64_t cycles;
-	void *font_scaled;
-} world_t;
-
-static world_t world = {
-	.window_height               = 800.0,
-	.window_width                = 800.0,
-	.window_x_starting_position  = 60.0,
-	.window_y_starting_position  = 20.0,
-	.window_scale_x              = 1.0,
-	.window_scale_y              = 1.0,
-	.tick                        = 0,
-	.halt_simulation             = false,
-	.arena_tick_ms               = 30, /**@todo This should be automatically adjusted based on frame rate */
-	.use_uart_input              = true,
-	.debug_extra                 = false,
-	.step                        = false,
-	.debug_mode                  = false,
-	.cycle_count                 = 0,
-	.cycles                      = CYCLE_INITIAL,
-	.font_scaled                 = GLUT_STROKE_MONO_ROMAN
-};
-
-typedef enum {
-	TRIANGLE,
-	SQUARE,
-	PENTAGON,
-	HEXAGON,
-	SEPTAGON,
-	OCTAGON,
-	DECAGON,
-	CIRCLE,
-	INVALID_SHAPE
-} shape_e;
-
-typedef shape_e shape_t;
-
-typedef struct {
-	double x;
-	double y;
-} scale_t;
-
-typedef struct {
-	double x, y;
-	bool draw_border;
-	color_t color_text, color_box;
-	double width, height;
-} textbox_t;
-
-typedef struct { /**@note it might be worth translating some functions to use points*/
-	double x, y;
-} point_t;
-
-static void terminal_default_command_sequence(vt100_t *t)
-{
-	assert(t);
-	t->n1 = 1;
-	t->n2 = 1;
-	t->command_index = 0;
-}
-
 static void terminal_at_xy(vt100_t *t, unsigned x, unsigned y, bool limit_not_wrap)
 {
 	assert(t);
@@ -340,1010 +131,1862 @@ static void terminal_at_xy_relative(vt100_t *t, int x, int y, bool limit_not_wra
 	terminal_at_xy(t, MAX(x_current + x, 0), MAX(y_current + y, 0), limit_not_wrap);
 }
 
+static const vt100_attribute_t vt100_default_attribute = VT100_ATTRIBUTE(WHITE, BLACK, 0);
+
 static void terminal_parse_attribute(vt100_attribute_t *a, unsigned v)
 {
 	switch(v) {
-	case 0:
-		memset(a, 0, sizeof(*a));
-		a->foreground_color = WHITE;
-		a->background_color = BLACK;
-		return;
-	case 1: a->bold          = true; return;
-	case 4: a->under_score   = true; return;
-	case 5: a->blink         = true; return;
-	case 7: a->reverse_video = true; return;
-	case 8: a->conceal       = true; return;
+	case 0:  *a = vt100_default_attribute; return;
+	case 1:  *a |= VT100_BOLD;             return;
+	case 4:  *a |= VT100_UNDER_SCORE;      return;
+	case 5:  *a |= VT100_BLINK;            return;
+	case 7:  *a |= VT100_REVERSE_VIDEO;    return;
+	case 8:  *a |= VT100_CONCEAL;          return;
+	case 22: *a &= ~VT100_BOLD;            return;
+	case 24: *a &= ~VT100_UNDER_SCORE;     return;
+	case 25: *a &= ~VT100_BLINK;           return;
+	case 27: *a &= ~VT100_REVERSE_VIDEO;   return;
+	case 28: *a &= ~VT100_CONCEAL;         return;
+	case 39: *a = vt100_foreground_set(*a, vt100_foreground(vt100_default_attribute)); return;
+	case 49: *a = vt100_background_set(*a, vt100_background(vt100_default_attribute)); return;
 	default:
 		if(v >= 30 && v <= 37)
-			a->foreground_color = v - 30;
+			*a = vt100_foreground_set(*a, v - 30);
 		if(v >= 40 && v <= 47)
-			a->background_color = v - 40;
+			*a = vt100_background_set(*a, v - 40);
+		if(v >= 90 && v <= 97) /* bright colors, 8 to 15 in the palette */
+			*a = vt100_foreground_set(*a, v - 90 + 8);
+		if(v >= 100 && v <= 107)
+			*a = vt100_background_set(*a, v - 100 + 8);
 	}
 }
 
-static const vt100_attribute_t vt100_default_attribute = {
-	.foreground_color = WHITE,
-	.background_color = BLACK,
-};
+/* Colors 16 to 231 of the 256 color palette are a 6x6x6 cube with these
+ * levels on each channel, 232 to 255 are a ramp of grays. */
+static const uint8_t terminal_cube_levels[] = { 0, 95, 135, 175, 215, 255 };
 
-static void terminal_attribute_block_set(vt100_t *t, size_t size, const vt100_attribute_t const *a)
+void vt100_palette(unsigned color, uint8_t rgb[3])
 {
-	assert(t);
-	assert(a);
-	for(size_t i = 0; i < size; i++)
-		memcpy(&t->attributes[i], a, sizeof(*a));
+	static const uint8_t basic[16][3] = {
+		{   0,   0,   0 }, { 205,   0,   0 }, {   0, 205,   0 }, { 205, 205,   0 },
+		{   0,   0, 238 }, { 205,   0, 205 }, {   0, 205, 205 }, { 229, 229, 229 },
+		{ 127, 127, 127 }, { 255,   0,   0 }, {   0, 255,   0 }, { 255, 255,   0 },
+		{  92,  92, 255 }, { 255,   0, 255 }, {   0, 255, 255 }, { 255, 255, 255 },
+	};
+	assert(rgb);
+	color &= VT100_COLOR_MASK;
+	if(color < 16) {
+		memcpy(rgb, basic[color], 3);
+	} else if(color < 232) {
+		color -= 16;
+		rgb[0] = terminal_cube_levels[(color / 36) % 6];
+		rgb[1] = terminal_cube_levels[(color / 6) % 6];
+		rgb[2] = terminal_cube_levels[color % 6];
+	} else {
+		rgb[0] = rgb[1] = rgb[2] = 8 + ((color - 232) * 10);
+	}
 }
 
-static int terminal_escape_sequences(vt100_t *t, uint8_t c)
+static unsigned terminal_cube_index(unsigned v)
 {
-	assert(t);
-	assert(t->state != TERMINAL_NORMAL_MODE);
-	switch(t->state) {
-	case TERMINAL_CSI:
-		if(c == '[')
-			t->state = TERMINAL_COMMAND;
-		else
-			goto fail;
-		break;
-	case TERMINAL_COMMAND:
-		switch(c) {
-		case 's':
-			t->cursor_saved = t->cursor;
-			goto success;
-		case 'n':
-			t->cursor = t->cursor_saved;
-			goto success;
-		case '?':
-			terminal_default_command_sequence(t);
-			t->state = TERMINAL_DECTCEM;
-			break;
-		case ';':
-			terminal_default_command_sequence(t);
-			t->state = TERMINAL_NUMBER_2;
-			break;
-		default:
-			if(isdigit(c)) {
-				terminal_default_command_sequence(t);
-				t->command_index++;
-				t->n1 = c - '0';
-				t->state = TERMINAL_NUMBER_1;
-			} else {
-				goto fail;
-			}
-		}
-		break;
-	case TERMINAL_NUMBER_1:
-		if(isdigit(c)) {
-			if(t->command_index > 3)
-				goto fail;
-			t->n1 = (t->n1 * (t->command_index ? 10 : 0)) + (c - '0');
-			t->command_index++;
-			break;
-		}
+	return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+}
 
-		switch(c) {
-		case 'A': terminal_at_xy_relative(t,  0,     -t->n1, true); goto success;/* relative cursor up */
-		case 'B': terminal_at_xy_relative(t,  0,      t->n1, true); goto success;/* relative cursor down */
-		case 'C': terminal_at_xy_relative(t,  t->n1,  0,     true); goto success;/* relative cursor forward */
-		case 'D': terminal_at_xy_relative(t, -t->n1,  0,     true); goto success;/* relative cursor back */
-		case 'E': terminal_at_xy(t, 0,  t->n1, false); goto success; /* relative cursor down, beginning of line */
-		case 'F': terminal_at_xy(t, 0, -t->n1, false); goto success; /* relative cursor up, beginning of line */
-		case 'G': terminal_at_xy(t, t->n1, terminal_y_current(t), true); goto success; /* move the cursor to column n */
-		case 'm': /* set attribute, CSI number m */
-			terminal_parse_attribute(&t->attribute, t->n1);
-			t->attributes[t->cursor] = t->attribute;
-			goto success;
-		case 'i': /* AUX Port On == 5, AUX Port Off == 4 */
-			if(t->n1 == 5 || t->n1 == 4)
-				goto success;
-			goto fail;
-		case 'n': /* Device Status Report */
-			/** @note This should transmit to the H2 system the
-			 * following "ESC[n;mR", where n is the row and m is the column,
-			 * we're not going to do this, although fifo_push() on
-			 * uart_rx_fifo could be called to do this */
-			if(t->n1 == 6)
-				goto success;
-			goto fail;
-		case 'J': /* reset */
-			switch(t->n1) {
-			case 3:
-			case 2: t->cursor = 0; /* with cursor */
-			case 1:
-				if(t->command_index) {
-					memset(t->m, ' ', t->size);
-					terminal_attribute_block_set(t, t->size, &vt100_default_attribute);
-					goto success;
-				} /* fall through if number not supplied */
-			case 0:
-				memset(t->m, ' ', t->cursor);
-				terminal_attribute_block_set(t, t->cursor, &vt100_default_attribute);
-				goto success;
-			}
-			goto fail;
-		case ';':
-			t->command_index = 0;
-			t->state = TERMINAL_NUMBER_2;
-			break;
-		default:
-			goto fail;
+static unsigned terminal_distance(const uint8_t a[3], unsigned r, unsigned g, unsigned b)
+{
+	const int dr = a[0] - (int)r, dg = a[1] - (int)g, db = a[2] - (int)b;
+	return (dr * dr) + (dg * dg) + (db * db);
+}
+
+/**@brief the closest color in the 256 color palette to a true color, from
+ * the color cube or the gray ramp */
+static unsigned terminal_quantize(unsigned r, unsigned g, unsigned b)
+{
+	r = MIN(r, 255u);
+	g = MIN(g, 255u);
+	b = MIN(b, 255u);
+	const unsigned cube = 16 + (36 * terminal_cube_index(r)) + (6 * terminal_cube_index(g)) + terminal_cube_index(b);
+	const unsigned average = (r + g + b) / 3;
+	const unsigned gray = 232 + (average > 238 ? 23 : average < 8 ? 0 : (average - 8) / 10);
+	uint8_t c[3], y[3];
+	vt100_palette(cube, c);
+	vt100_palette(gray, y);
+	return terminal_distance(y, r, g, b) < terminal_distance(c, r, g, b) ? gray : cube;
+}
+
+/**@brief apply a whole list of SGR parameters in one go, including the
+ * extended colors "38;5;n" and "38;2;r;g;b", and "48" likewise for the
+ * background. True colors are reduced to the closest palette color. */
+static void terminal_sgr(vt100_t *t)
+{
+	assert(t);
+	const uint16_t *p = t->parameters;
+	const unsigned n = MAX(MIN(t->parameter_count, VT100_PARAMETERS), 1); /* none is a reset */
+	vt100_attribute_t a = t->attribute;
+	for(unsigned i = 0; i < n; i++) {
+		if(p[i] != 38 && p[i] != 48) {
+			terminal_parse_attribute(&a, p[i]);
+			continue;
 		}
-		break;
-	case TERMINAL_NUMBER_2:
-		if(isdigit(c)) {
-			if(t->command_index > 3)
-				goto fail;
-			t->n2 = (t->n2 * (t->command_index ? 10 : 0)) + (c - '0');
-			t->command_index++;
+		unsigned color = 0;
+		if((i + 2) < n && p[i + 1] == 5) {
+			color = MIN(p[i + 2], 255u);
+		} else if((i + 4) < n && p[i + 1] == 2) {
+			color = terminal_quantize(p[i + 2], p[i + 3], p[i + 4]);
 		} else {
-			switch(c) {
-			case 'm':
-				terminal_parse_attribute(&t->attribute, t->n1);
-				terminal_parse_attribute(&t->attribute, t->n2);
-				t->attributes[t->cursor] = t->attribute;
-				goto success;
-			case 'H':
-			case 'f':
-				terminal_at_xy(t, t->n2, t->n1, true);
-				goto success;
-			}
-			goto fail;
-		}
-		break;
-	case TERMINAL_DECTCEM:
-		if(isdigit(c)) {
-			if(t->command_index > 1)
-				goto fail;
-			t->n1 = (t->n1 * (t->command_index ? 10 : 0)) + (c - '0');
-			t->command_index++;
-			break;
-		}
-
-		if(t->n1 != 25)
-			goto fail;
-		switch(c) {
-		case 'l': t->cursor_on = false; goto success;
-		case 'h': t->cursor_on = true;  goto success;
-		default:
-			goto fail;
+			break; /* the rest cannot be made sense of */
 		}
-	case TERMINAL_STATE_END:
-		t->state = TERMINAL_NORMAL_MODE;
-		break;
-	default:
-		fatal("invalid terminal state: %u", (unsigned)t->state);
+		a = p[i] == 38 ? vt100_foreground_set(a, color) : vt100_background_set(a, color);
+		i += p[i + 1] == 5 ? 2 : 4;
 	}
+	t->attribute = a;
+}
 
-	return 0;
-success:
-	t->state = TERMINAL_NORMAL_MODE;
-	return 0;
-fail:
-	t->state = TERMINAL_NORMAL_MODE;
-	return -1;
+/**@brief translate a position on the display into an index into m[] */
+static size_t terminal_cell(const vt100_t *t, size_t cursor)
+{
+	assert(t);
+	assert(cursor < t->size);
+	const size_t y = t->rows[(t->top + (cursor / t->width)) % t->height];
+	return (y * t->width) + (cursor % t->width);
 }
 
-void vt100_update(vt100_t *t, uint8_t c)
+static void terminal_attribute_block_set(vt100_t *t, size_t start, size_t size, vt100_attribute_t a)
 {
 	assert(t);
-	assert(t->size <= VT100_MAX_SIZE);
-	assert((t->width * t->height) <= VT100_MAX_SIZE);
+	assert((start + size) <= t->size);
+	vt100_attribute_t *attributes = &t->attributes[start];
+	for(size_t i = 0; i < size; i++)
+		attributes[i] = a;
+}
 
-	if(t->state != TERMINAL_NORMAL_MODE) {
-		if(terminal_escape_sequences(t, c)) {
-			t->state = TERMINAL_NORMAL_MODE;
-			/*warning("invalid ANSI command sequence");*/
-		}
-	} else {
-		switch(c) {
-		case ESCAPE:
-			t->state = TERMINAL_CSI;
-			break;
-		case '\t':
-			t->cursor += 8;
-			t->cursor &= ~0x7;
-			break;
-		case '\r':
-		case '\n':
-			t->cursor += t->width;
-			t->cursor = (t->cursor / t->width) * t->width;
-			break;
-		case DELETE:
-		case BACKSPACE:
-			terminal_at_xy_relative(t, -1, 0, true);
-			t->m[t->cursor] = ' ';
-			break;
-		default:
-			assert(t->cursor < t->size);
-			t->m[t->cursor] = c;
-			memcpy(&t->attributes[t->cursor], &t->attribute, sizeof(t->attribute));
-			t->cursor++;
-		}
-		if(t->cursor >= t->size) {
-			terminal_attribute_block_set(t, t->size, &vt100_default_attribute);
-			memset(t->m, ' ', t->size);
-		}
-		t->cursor %= t->size;
+/**@brief the row of m[] shown on row 'y' of the display */
+static size_t terminal_row(const vt100_t *t, size_t y)
+{
+	assert(t);
+	assert(y < t->height);
+	return t->rows[(t->top + y) % t->height];
+}
+
+/**@brief record that 'count' cells of the display starting at 'start'
+ * have changed */
+static void terminal_damage(vt100_t *t, size_t start, size_t count)
+{
+	assert(t);
+	assert((start + count) <= t->size);
+	if(!count)
+		return;
+	const size_t end = start + count - 1;
+	const unsigned y0 = start / t->width, y1 = end / t->width;
+	unsigned x0 = start % t->width, x1 = end % t->width;
+	if(y0 != y1) {
+		x0 = 0;
+		x1 = t->width - 1;
+	}
+	memset(&t->dirty[y0], true, (y1 - y0) + 1);
+
+	vt100_damage_t *d = &t->damage;
+	if(d->x0 >= d->x1) {
+		d->x0 = x0;
+		d->y0 = y0;
+		d->x1 = x1 + 1;
+		d->y1 = y1 + 1;
+		return;
 	}
+	d->x0 = MIN(d->x0, x0);
+	d->y0 = MIN(d->y0, y0);
+	d->x1 = MAX(d->x1, x1 + 1);
+	d->y1 = MAX(d->y1, y1 + 1);
 }
 
-/**@bug not quite correct, arena_tick_ms is what we request, not want the arena
- * tick actually is */
-static double seconds_to_ticks(const world_t *world, double s)
+/**@brief blank 'count' cells of the display starting at 'start' */
+static void terminal_erase(vt100_t *t, size_t start, size_t count)
 {
-	assert(world);
-	return s * (1000. / (double)world->arena_tick_ms);
+	assert(t);
+	assert((start + count) <= t->size);
+	terminal_damage(t, start, count);
+	for(size_t y = (start + t->width - 1) / t->width; ((y + 1) * t->width) <= (start + count); y++)
+		t->wrapped[terminal_row(t, y)] = false;
+	while(count) { /* a row at a time, they need not be next to each other */
+		const size_t i = terminal_cell(t, start);
+		const size_t n = MIN(count, t->width - (start % t->width));
+		memset(&t->m[i], ' ', n);
+		terminal_attribute_block_set(t, i, n, vt100_default_attribute);
+		start += n;
+		count -= n;
+	}
 }
 
-static double rad2deg(double rad)
+/**@brief shift the cells of the cursor's row from the cursor onward 'n'
+ * places right (ICH) or left (DCH), blanking the cells that open up */
+static void terminal_shift(vt100_t *t, unsigned n, bool right)
 {
-	return (rad / (2.0 * PI)) * 360.0;
+	assert(t);
+	const size_t x = t->cursor % t->width;
+	n = MIN(n, t->width - x);
+	const size_t i = terminal_cell(t, t->cursor), moved = t->width - x - n;
+	const size_t to = right ? i + n : i, from = right ? i : i + n;
+	memmove(&t->m[to], &t->m[from], moved);
+	memmove(&t->attributes[to], &t->attributes[from], moved * sizeof(t->attributes[0]));
+	terminal_erase(t, right ? t->cursor : t->cursor + moved, n);
+	terminal_damage(t, t->cursor, t->width - x);
 }
 
-static void set_color(color_t color, bool light)
+static bool terminal_blank(const uint8_t *m, const vt100_attribute_t *a)
 {
-	double ON = light ? 0.8 : 0.4;
-	static const double OFF = 0.0;
-	switch(color) {      /* RED  GRN  BLU */
-	case WHITE:   glColor3f( ON,  ON,  ON);   break;
-	case RED:     glColor3f( ON, OFF, OFF);   break;
-	case YELLOW:  glColor3f( ON,  ON, OFF);   break;
-	case GREEN:   glColor3f(OFF,  ON, OFF);   break;
-	case CYAN:    glColor3f(OFF,  ON,  ON);   break;
-	case BLUE:    glColor3f(OFF, OFF,  ON);   break;
-	case MAGENTA: glColor3f( ON, OFF,  ON);   break;
-	case BLACK:   glColor3f(OFF, OFF, OFF);   break;
-	default:      fatal("invalid color '%d'", color);
-	}
+	return *m == ' ' && *a == vt100_default_attribute;
 }
 
-/* see: https://www.opengl.org/discussion_boards/showthread.php/160784-Drawing-Circles-in-OpenGL */
-static void _draw_regular_polygon(
-		double x, double y,
-		double orientation,
-		double radius, double sides,
-		bool lines, double thickness,
-		color_t color)
-{
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-		glLoadIdentity();
-		glTranslatef(x, y, 0.0);
-		glRotated(rad2deg(orientation), 0, 0, 1);
-		set_color(color, true);
-		if(lines) {
-			glLineWidth(thickness);
-			glBegin(GL_LINE_LOOP);
-		} else {
-			glBegin(GL_POLYGON);
-		}
-			for(double i = 0; i < 2.0 * PI; i += PI / sides)
-				glVertex3d(cos(i) * radius, sin(i) * radius, 0.0);
-		glEnd();
-	glPopMatrix();
-}
-
-static void _draw_rectangle(double x, double y, double width, double height, bool lines, double thickness, color_t color)
-{
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-		glLoadIdentity();
-		glRasterPos2d(x, y);
-		set_color(color, true);
-		if(lines) {
-			glLineWidth(thickness);
-			glBegin(GL_LINE_LOOP);
-		} else {
-			glBegin(GL_POLYGON);
-		}
-		glVertex3d(x,       y,        0);
-		glVertex3d(x+width, y,        0);
-		glVertex3d(x+width, y+height, 0);
-		glVertex3d(x,       y+height, 0);
-		glEnd();
-	glPopMatrix();
+/* The arena is on the heap, or with vt100_scrollback_file() in a file that
+ * is mapped into memory a segment at a time. Lines in a file never move,
+ * the offset of a line is where it is in the arena, and no line is split
+ * between two segments. The file starts with the index, mapped whole, and
+ * the segments follow it. A segment that only held dropped lines gives its
+ * place in the file to a later segment, so the file grows no bigger than
+ * the lines held need. */
+
+/**@brief where 'line' of the scrollback is, counting from the oldest line held */
+static vt100_line_t *terminal_scrollback_index(const vt100_scrollback_t *s, size_t line)
+{
+	assert(s);
+	assert(line < s->count);
+	return &s->index[(s->head + s->capacity - s->count + line) % s->capacity];
 }
 
-static void draw_rectangle_filled(double x, double y, double width, double height, color_t color)
+static uint8_t *terminal_arena_at(const vt100_scrollback_t *s, size_t offset)
 {
-	return _draw_rectangle(x, y, width, height, false, 0, color);
+	assert(s);
+	if(s->fd < 0)
+		return &s->arena[offset];
+	const size_t segment = offset / VT100_SEGMENT_SIZE;
+	assert(segment >= s->unmapped && segment < s->segments);
+	return &s->segment[segment % s->segments_max][offset % VT100_SEGMENT_SIZE];
 }
 
-static void draw_rectangle_line(double x, double y, double width, double height, double thickness, color_t color)
+/**@brief the bytes at the start of the file taken by an index of 'lines'
+ * lines, a whole number of segments so the segments stay page aligned */
+static size_t terminal_index_size(size_t lines)
 {
-	return _draw_rectangle(x, y, width, height, true, thickness, color);
+	const size_t bytes = lines * sizeof(vt100_line_t);
+	return ((bytes + VT100_SEGMENT_SIZE - 1) / VT100_SEGMENT_SIZE) * VT100_SEGMENT_SIZE;
 }
 
-static double shape_to_sides(shape_t shape)
+/**@brief map another segment onto the end of the arena, in the place in the
+ * file of the oldest unmapped segment if there is one, or else growing the
+ * file by a segment. segment[] and place[] are rings holding the segments
+ * from 'recycled' up to 'segments'. */
+static void terminal_segment_map(vt100_scrollback_t *s)
 {
-	static const double sides[] =
-	{
-		[TRIANGLE] = 1.5,
-		[SQUARE]   = 2,
-		[PENTAGON] = 2.5,
-		[HEXAGON]  = 3,
-		[SEPTAGON] = 3.5,
-		[OCTAGON]  = 4,
-		[DECAGON]  = 5,
-		[CIRCLE]   = 24
-	};
-	if(shape >= INVALID_SHAPE)
-		fatal("invalid shape '%d'", shape);
-	return sides[shape % INVALID_SHAPE];
+	assert(s);
+	assert(s->fd >= 0);
+	size_t place = s->file_segments;
+	if(s->recycled < s->unmapped) {
+		place = s->place[s->recycled % s->segments_max];
+		s->recycled++;
+	}
+	if((s->segments - s->recycled) == s->segments_max) {
+		const size_t max = MAX(s->segments_max * 2, (size_t)16);
+		uint8_t **segment = allocate_or_die(max * sizeof(segment[0]));
+		size_t *places = allocate_or_die(max * sizeof(places[0]));
+		for(size_t i = s->recycled; i < s->segments; i++) {
+			segment[i % max] = s->segment[i % s->segments_max];
+			places[i % max]  = s->place[i % s->segments_max];
+		}
+		free(s->segment);
+		free(s->place);
+		s->segment      = segment;
+		s->place        = places;
+		s->segments_max = max;
+	}
+	const off_t offset = (off_t)(terminal_index_size(s->lines) + (place * VT100_SEGMENT_SIZE));
+	errno = 0;
+	if(place == s->file_segments) {
+		if(ftruncate(s->fd, offset + VT100_SEGMENT_SIZE) < 0)
+			fatal("failed to grow the scrollback file to %zu bytes: %s", (size_t)offset + VT100_SEGMENT_SIZE, reason());
+		s->file_segments++;
+	}
+	void *m = mmap(NULL, VT100_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, offset);
+	if(m == MAP_FAILED)
+		fatal("failed to map scrollback segment %zu: %s", s->segments, reason());
+	s->segment[s->segments % s->segments_max] = m;
+	s->place[s->segments % s->segments_max]   = place;
+	s->segments++;
+	s->arena_size = s->segments * VT100_SEGMENT_SIZE;
 }
 
-/* static void draw_regular_polygon_filled(double x, double y, double orientation, double radius, shape_t shape, color_t color)
+/**@brief map the index at the start of the file, at its full size, the
+ * pages of it are only backed once lines are written to them */
+static void terminal_index_map(vt100_scrollback_t *s)
 {
-	double sides = shape_to_sides(shape);
-	_draw_regular_polygon(x, y, orientation, radius, sides, false, 0, color);
-} */
+	assert(s);
+	assert(s->fd >= 0 && s->lines);
+	const size_t size = terminal_index_size(s->lines);
+	errno = 0;
+	if(ftruncate(s->fd, (off_t)size) < 0)
+		fatal("failed to size the scrollback file to %zu bytes: %s", size, reason());
+	void *m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if(m == MAP_FAILED)
+		fatal("failed to map the scrollback index: %s", reason());
+	s->index    = m;
+	s->capacity = s->lines;
+}
 
-static void draw_regular_polygon_line(double x, double y, double orientation, double radius, shape_t shape, double thickness, color_t color)
+/**@brief make room for 'need' more bytes at the end of the arena. On the
+ * heap the lines still held are moved to the start of a new arena, twice as
+ * big as they need so this happens less and less often as it fills. In a
+ * file a line that would straddle two segments starts the next one instead,
+ * and segments holding only dropped lines are unmapped, before a new one is
+ * mapped so that it can take the place of one of them. */
+static void terminal_arena_reserve(vt100_scrollback_t *s, size_t need)
 {
-	double sides = shape_to_sides(shape);
-	_draw_regular_polygon(x, y, orientation, radius, sides, true, thickness, color);
+	assert(s);
+	if(s->fd >= 0) {
+		assert(need <= VT100_SEGMENT_SIZE);
+		const size_t room = VT100_SEGMENT_SIZE - (s->arena_used % VT100_SEGMENT_SIZE);
+		if(need > room && s->arena_used < s->arena_size)
+			s->arena_used += room;
+		for(; s->unmapped < (s->arena_start / VT100_SEGMENT_SIZE); s->unmapped++) {
+			munmap(s->segment[s->unmapped % s->segments_max], VT100_SEGMENT_SIZE);
+			s->segment[s->unmapped % s->segments_max] = NULL;
+		}
+		if((s->arena_used + need) > s->arena_size)
+			terminal_segment_map(s);
+		return;
+	}
+	if((s->arena_used + need) <= s->arena_size)
+		return;
+	const size_t live = s->arena_used - s->arena_start;
+	const size_t size = MAX((live + need) * 2, (size_t)s->width * 16);
+	uint8_t *arena = allocate_or_die(size);
+	if(live)
+		memcpy(arena, &s->arena[s->arena_start], live);
+	for(size_t i = 0; i < s->count; i++)
+		terminal_scrollback_index(s, i)->offset -= s->arena_start;
+	free(s->arena);
+	s->arena       = arena;
+	s->arena_size  = size;
+	s->arena_used  = live;
+	s->arena_start = 0;
 }
 
-static void draw_char(uint8_t c)
+/**@brief make room in the index for another line, the index grows until
+ * it holds 'lines' lines, after that the oldest line is dropped */
+static void terminal_index_reserve(vt100_scrollback_t *s)
 {
-	c = c >= 32 && c <= 127 ? c : '?';
-	glutStrokeCharacter(world.font_scaled, c);
+	assert(s);
+	if(s->count < s->capacity)
+		return;
+	if(s->count == s->lines) {
+		s->count--;
+		s->arena_start = s->count ? terminal_scrollback_index(s, 0)->offset : s->arena_used;
+		return;
+	}
+	const size_t capacity = MIN(MAX(s->capacity * 2, (size_t)64), s->lines);
+	vt100_line_t *index = allocate_or_die(capacity * sizeof(index[0]));
+	for(size_t i = 0; i < s->count; i++)
+		index[i] = *terminal_scrollback_index(s, i);
+	free(s->index);
+	s->index    = index;
+	s->capacity = capacity;
+	s->head     = s->count;
 }
 
-/* see: https://en.wikibooks.org/wiki/OpenGL_Programming/Modern_OpenGL_Tutorial_Text_Rendering_01
- *      https://stackoverflow.com/questions/538661/how-do-i-draw-text-with-glut-opengl-in-c
- *      https://stackoverflow.com/questions/20866508/using-glut-to-simply-print-text */
-static int draw_block(const uint8_t *msg, size_t len)
+/**@brief compact a row of cells and append it to the scrollback */
+static void terminal_scrollback_push(vt100_t *t, const uint8_t *m, const vt100_attribute_t *a, bool wrapped)
 {
-	assert(msg);
-	for(size_t i = 0; i < len; i++)
-		draw_char(msg[i]);
-	return len;
+	assert(t);
+	vt100_scrollback_t *s = &t->scrollback;
+	if(!s->lines)
+		return;
+	assert(s->width == t->width);
+	terminal_index_reserve(s);
+
+	size_t length = s->width, runs = 0;
+	while(length && terminal_blank(&m[length - 1], &a[length - 1]))
+		length--;
+	const size_t align = sizeof(vt100_run_t) - 1;
+	terminal_arena_reserve(s, (length * (sizeof(vt100_run_t) + 1)) + align); /* at worst a run per cell */
+
+	vt100_run_t *run = (vt100_run_t*)terminal_arena_at(s, s->arena_used);
+	for(size_t i = 0, j = 0; i < length; i = j) {
+		for(j = i + 1; j < length && a[j] == a[i]; j++)
+			;
+		run[runs].attribute = a[i];
+		run[runs].count     = j - i;
+		runs++;
+	}
+	vt100_line_t *l = &s->index[s->head];
+	l->offset  = s->arena_used;
+	l->length  = length;
+	l->runs    = runs;
+	l->wrapped = wrapped;
+	memcpy(&run[runs], m, length);
+	s->arena_used += ((runs * sizeof(vt100_run_t)) + length + align) & ~align;
+	s->head = (s->head + 1) % s->capacity;
+	s->count++;
+	s->pushed++;
 }
 
-static int draw_string(const char *msg)
+/**@brief expand 'line' of the scrollback, counting from the oldest line
+ * held, into the cache unless it is there already */
+static void terminal_scrollback_line(vt100_scrollback_t *s, size_t line, const uint8_t **m, const vt100_attribute_t **a, bool *wrapped)
 {
-	assert(msg);
-	return draw_block((uint8_t*)msg, strlen(msg));
+	assert(s);
+	const vt100_line_t *l = terminal_scrollback_index(s, line);
+	const size_t serial = s->pushed - s->count + line, slot = serial % s->slots;
+	uint8_t *cm = &s->m[slot * s->width];
+	vt100_attribute_t *ca = &s->attributes[slot * s->width];
+	if(s->cached[slot] != serial) {
+		const vt100_run_t *run = (const vt100_run_t*)terminal_arena_at(s, l->offset);
+		const size_t length = MIN(l->length, s->width); /* it may have been written wider */
+		size_t x = 0;
+		for(size_t r = 0; r < l->runs; r++)
+			for(size_t i = 0; i < run[r].count && x < length; i++)
+				ca[x++] = run[r].attribute;
+		for(; x < s->width; x++)
+			ca[x] = vt100_default_attribute;
+		memcpy(cm, &run[l->runs], length);
+		memset(&cm[length], ' ', s->width - length);
+		s->cached[slot] = serial;
+	}
+	*m = cm;
+	*a = ca;
+	if(wrapped)
+		*wrapped = l->wrapped;
 }
 
-static scale_t font_attributes(void)
+/**@brief reverse the order of the display rows from 'a' up to 'b' in rows[] */
+static void terminal_rows_reverse(vt100_t *t, size_t a, size_t b)
 {
-	static bool initialized = false;
-	static scale_t scale = { 0., 0.};
-	if(initialized)
-		return scale;
-	scale.y = glutStrokeHeight(world.font_scaled);
-	scale.x = glutStrokeWidth(world.font_scaled, 'M');
-	initialized = true;
-	return scale;
+	assert(t);
+	assert(a <= b && b <= t->height);
+	for(; (a + 1) < b; a++, b--) {
+		unsigned *x = &t->rows[(t->top + a) % t->height];
+		unsigned *y = &t->rows[(t->top + b - 1) % t->height];
+		const unsigned swap = *x;
+		*x = *y;
+		*y = swap;
+	}
 }
 
-static void draw_vt100_char(double x, double y, double scale_x, double scale_y, double orientation, uint8_t c, vt100_attribute_t *attr, bool blink)
+/**@brief scroll the display rows from 'a' up to 'b' by 'n' rows, up or
+ * down, the rows that open up are blank. No cells are moved, scrolling the
+ * whole display moves 'top' and anything less rotates rows[]. */
+static void terminal_scroll(vt100_t *t, size_t a, size_t b, size_t n, bool up)
 {
-	/*scale_t scale = font_attributes();
-	double char_width  = scale.x / X_MAX;
-       	double char_height = scale.y / Y_MAX;*/
+	assert(t);
+	assert(a < b && b <= t->height);
+	n = MIN(n, b - a);
+	if(!n)
+		return;
+	if(a == 0 && b == t->height) {
+		t->top = (t->top + (up ? n : t->height - n)) % t->height;
+	} else { /* rotate by reversing both parts and then the lot */
+		const size_t pivot = up ? a + n : b - n;
+		terminal_rows_reverse(t, a, pivot);
+		terminal_rows_reverse(t, pivot, b);
+		terminal_rows_reverse(t, a, b);
+	}
+	terminal_erase(t, (up ? b - n : a) * t->width, n * t->width);
+	terminal_damage(t, a * t->width, (b - a) * t->width);
+}
 
-	if(blink && attr->blink)
+/**@brief insert (IL) or delete (DL) 'n' rows at the cursor's row, the
+ * rows below it down to the bottom margin scroll down or up, nothing
+ * happens outside of the scroll region */
+static void terminal_lines(vt100_t *t, unsigned n, bool insert)
+{
+	assert(t);
+	const size_t y = t->cursor / t->width;
+	if(y < t->scroll_top || y >= t->scroll_bottom)
 		return;
+	terminal_scroll(t, y, t->scroll_bottom, n, !insert);
+	t->cursor = y * t->width;
+}
+
+/* ====================================== Parser =============================================== */
+
+/* The parser is the state machine of a DEC terminal, as described at
+ * <https://vt100.net/emu/dec_ansi_parser>. Each byte falls into one of
+ * sixteen classes and a table indexed by the current state and that class
+ * gives the action to take and the state to move to, the actions for
+ * entering and leaving a state are applied whenever the state changes. The
+ * C1 controls, 0x80 to 0x9F, are not recognized, the output of most
+ * programs is UTF-8 which they would break up, so every byte with the top
+ * bit set is printed. */
+
+typedef enum {
+	TERMINAL_CLASS_C0,           /* other control characters */
+	TERMINAL_CLASS_BEL,          /* also ends an OSC string, as xterm does */
+	TERMINAL_CLASS_CANCEL,       /* CAN and SUB */
+	TERMINAL_CLASS_ESCAPE,
+	TERMINAL_CLASS_INTERMEDIATE, /* 0x20 to 0x2F */
+	TERMINAL_CLASS_DIGIT,
+	TERMINAL_CLASS_COLON,
+	TERMINAL_CLASS_SEMICOLON,
+	TERMINAL_CLASS_PRIVATE,      /* 0x3C to 0x3F */
+	TERMINAL_CLASS_FINAL,        /* 0x40 to 0x7E, apart from those below */
+	TERMINAL_CLASS_DCS,          /* 'P' */
+	TERMINAL_CLASS_SOS,          /* 'X', '^' and '_' */
+	TERMINAL_CLASS_CSI,          /* '[' */
+	TERMINAL_CLASS_OSC,          /* ']' */
+	TERMINAL_CLASS_DELETE,
+	TERMINAL_CLASS_HIGH,         /* 0x80 to 0xFF */
+	TERMINAL_CLASS_END,
+} terminal_class_t;
+
+typedef enum {
+	TERMINAL_ACTION_NONE,
+	TERMINAL_ACTION_PRINT,
+	TERMINAL_ACTION_EXECUTE,
+	TERMINAL_ACTION_COLLECT,
+	TERMINAL_ACTION_PARAM,
+	TERMINAL_ACTION_ESC_DISPATCH,
+	TERMINAL_ACTION_CSI_DISPATCH,
+	TERMINAL_ACTION_PUT,
+	TERMINAL_ACTION_OSC_PUT,
+} terminal_action_t;
+
+#define TERMINAL_STAY (0xF) /* a transition that does not change state */
+
+static const uint8_t terminal_classes[256] = {
+	[0x00 ... 0x06] = TERMINAL_CLASS_C0,
+	[0x07]          = TERMINAL_CLASS_BEL,
+	[0x08 ... 0x17] = TERMINAL_CLASS_C0,
+	[0x18]          = TERMINAL_CLASS_CANCEL,
+	[0x19]          = TERMINAL_CLASS_C0,
+	[0x1A]          = TERMINAL_CLASS_CANCEL,
+	[ESCAPE]        = TERMINAL_CLASS_ESCAPE,
+	[0x1C ... 0x1F] = TERMINAL_CLASS_C0,
+	[0x20 ... 0x2F] = TERMINAL_CLASS_INTERMEDIATE,
+	['0' ... '9']   = TERMINAL_CLASS_DIGIT,
+	[':']           = TERMINAL_CLASS_COLON,
+	[';']           = TERMINAL_CLASS_SEMICOLON,
+	[0x3C ... 0x3F] = TERMINAL_CLASS_PRIVATE,
+	['@' ... 'O']   = TERMINAL_CLASS_FINAL,
+	['P']           = TERMINAL_CLASS_DCS,
+	['Q' ... 'W']   = TERMINAL_CLASS_FINAL,
+	['X']           = TERMINAL_CLASS_SOS,
+	['Y' ... 'Z']   = TERMINAL_CLASS_FINAL,
+	['[']           = TERMINAL_CLASS_CSI,
+	['\\']          = TERMINAL_CLASS_FINAL,
+	[']']           = TERMINAL_CLASS_OSC,
+	['^' ... '_']   = TERMINAL_CLASS_SOS,
+	['`' ... '~']   = TERMINAL_CLASS_FINAL,
+	[DELETE]        = TERMINAL_CLASS_DELETE,
+	[0x80 ... 0xFF] = TERMINAL_CLASS_HIGH,
+};
+
+/* Each entry holds the action in the top four bits and the next state in
+ * the bottom four, the columns are in terminal_class_t order, four to a
+ * line. DELETE is executed in the ground state, as a backspace, where the
+ * DEC terminals ignored it. */
+#define T(ACTION, STATE) (uint8_t)(((ACTION) << 4) | (STATE))
+#define NONE  TERMINAL_ACTION_NONE
+#define PRINT TERMINAL_ACTION_PRINT
+#define EXEC  TERMINAL_ACTION_EXECUTE
+#define COLL  TERMINAL_ACTION_COLLECT
+#define PARA  TERMINAL_ACTION_PARAM
+#define ESCD  TERMINAL_ACTION_ESC_DISPATCH
+#define CSID  TERMINAL_ACTION_CSI_DISPATCH
+#define PUT   TERMINAL_ACTION_PUT
+#define OSCP  TERMINAL_ACTION_OSC_PUT
+#define STAY TERMINAL_STAY
+#define GRND TERMINAL_GROUND
+#define ESC  TERMINAL_ESCAPE
+#define ESCI TERMINAL_ESCAPE_INTERMEDIATE
+#define CSIE TERMINAL_CSI_ENTRY
+#define CSIP TERMINAL_CSI_PARAM
+#define CSII TERMINAL_CSI_INTERMEDIATE
+#define CSIX TERMINAL_CSI_IGNORE
+#define DCSE TERMINAL_DCS_ENTRY
+#define DCSP TERMINAL_DCS_PARAM
+#define DCSI TERMINAL_DCS_INTERMEDIATE
+#define DCSS TERMINAL_DCS_PASSTHROUGH
+#define DCSX TERMINAL_DCS_IGNORE
+#define OSC  TERMINAL_OSC_STRING
+#define SOS  TERMINAL_SOS_STRING
+static const uint8_t terminal_transitions[TERMINAL_STATE_END][TERMINAL_CLASS_END] = {
+	[TERMINAL_GROUND] = {
+		T(EXEC, STAY),  T(EXEC, STAY),  T(EXEC, STAY),  T(NONE, ESC),
+		T(PRINT, STAY), T(PRINT, STAY), T(PRINT, STAY), T(PRINT, STAY),
+		T(PRINT, STAY), T(PRINT, STAY), T(PRINT, STAY), T(PRINT, STAY),
+		T(PRINT, STAY), T(PRINT, STAY), T(EXEC, STAY),  T(PRINT, STAY),
+	},
+	[TERMINAL_ESCAPE] = {
+		T(EXEC, STAY),  T(EXEC, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, ESCI),  T(ESCD, GRND),  T(ESCD, GRND),  T(ESCD, GRND),
+		T(ESCD, GRND),  T(ESCD, GRND),  T(NONE, DCSE),  T(NONE, SOS),
+		T(NONE, CSIE),  T(NONE, OSC),   T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_ESCAPE_INTERMEDIATE] = {
+		T(EXEC, STAY),  T(EXEC, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, STAY),  T(ESCD, GRND),  T(ESCD, GRND),  T(ESCD, GRND),
+		T(ESCD, GRND),  T(ESCD, GRND),  T(ESCD, GRND),  T(ESCD, GRND),
+		T(ESCD, GRND),  T(ESCD, GRND),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_CSI_ENTRY] = {
+		T(EXEC, STAY),  T(EXEC, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, CSII),  T(PARA, CSIP),  T(NONE, CSIX),  T(PARA, CSIP),
+		T(COLL, CSIP),  T(CSID, GRND),  T(CSID, GRND),  T(CSID, GRND),
+		T(CSID, GRND),  T(CSID, GRND),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_CSI_PARAM] = {
+		T(EXEC, STAY),  T(EXEC, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, CSII),  T(PARA, STAY),  T(NONE, CSIX),  T(PARA, STAY),
+		T(NONE, CSIX),  T(CSID, GRND),  T(CSID, GRND),  T(CSID, GRND),
+		T(CSID, GRND),  T(CSID, GRND),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_CSI_INTERMEDIATE] = {
+		T(EXEC, STAY),  T(EXEC, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, STAY),  T(NONE, CSIX),  T(NONE, CSIX),  T(NONE, CSIX),
+		T(NONE, CSIX),  T(CSID, GRND),  T(CSID, GRND),  T(CSID, GRND),
+		T(CSID, GRND),  T(CSID, GRND),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_CSI_IGNORE] = {
+		T(EXEC, STAY),  T(EXEC, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),
+		T(NONE, STAY),  T(NONE, GRND),  T(NONE, GRND),  T(NONE, GRND),
+		T(NONE, GRND),  T(NONE, GRND),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_DCS_ENTRY] = {
+		T(NONE, STAY),  T(NONE, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, DCSI),  T(PARA, DCSP),  T(NONE, DCSX),  T(PARA, DCSP),
+		T(COLL, DCSP),  T(NONE, DCSS),  T(NONE, DCSS),  T(NONE, DCSS),
+		T(NONE, DCSS),  T(NONE, DCSS),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_DCS_PARAM] = {
+		T(NONE, STAY),  T(NONE, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, DCSI),  T(PARA, STAY),  T(NONE, DCSX),  T(PARA, STAY),
+		T(NONE, DCSX),  T(NONE, DCSS),  T(NONE, DCSS),  T(NONE, DCSS),
+		T(NONE, DCSS),  T(NONE, DCSS),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_DCS_INTERMEDIATE] = {
+		T(NONE, STAY),  T(NONE, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(COLL, STAY),  T(NONE, DCSX),  T(NONE, DCSX),  T(NONE, DCSX),
+		T(NONE, DCSX),  T(NONE, DCSS),  T(NONE, DCSS),  T(NONE, DCSS),
+		T(NONE, DCSS),  T(NONE, DCSS),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_DCS_PASSTHROUGH] = {
+		T(PUT, STAY),   T(PUT, STAY),   T(EXEC, GRND),  T(NONE, ESC),
+		T(PUT, STAY),   T(PUT, STAY),   T(PUT, STAY),   T(PUT, STAY),
+		T(PUT, STAY),   T(PUT, STAY),   T(PUT, STAY),   T(PUT, STAY),
+		T(PUT, STAY),   T(PUT, STAY),   T(NONE, STAY),  T(PUT, STAY),
+	},
+	[TERMINAL_DCS_IGNORE] = {
+		T(NONE, STAY),  T(NONE, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),
+		T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),
+		T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),
+	},
+	[TERMINAL_OSC_STRING] = {
+		T(NONE, STAY),  T(NONE, GRND),  T(EXEC, GRND),  T(NONE, ESC),
+		T(OSCP, STAY),  T(OSCP, STAY),  T(OSCP, STAY),  T(OSCP, STAY),
+		T(OSCP, STAY),  T(OSCP, STAY),  T(OSCP, STAY),  T(OSCP, STAY),
+		T(OSCP, STAY),  T(OSCP, STAY),  T(OSCP, STAY),  T(OSCP, STAY),
+	},
+	[TERMINAL_SOS_STRING] = {
+		T(NONE, STAY),  T(NONE, STAY),  T(EXEC, GRND),  T(NONE, ESC),
+		T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),
+		T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),
+		T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),  T(NONE, STAY),
+	},
+};
+#undef T
+#undef NONE
+#undef PRINT
+#undef EXEC
+#undef COLL
+#undef PARA
+#undef ESCD
+#undef CSID
+#undef PUT
+#undef OSCP
+#undef STAY
+#undef GRND
+#undef ESC
+#undef ESCI
+#undef CSIE
+#undef CSIP
+#undef CSII
+#undef CSIX
+#undef DCSE
+#undef DCSP
+#undef DCSI
+#undef DCSS
+#undef DCSX
+#undef OSC
+#undef SOS
+
+static bool terminal_is_control(uint8_t c)
+{
+	return c < 0x20 || c == DELETE;
+}
 
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-		glLoadIdentity();
-		glTranslatef(x, y, 0.0);
-		glScaled(scale_x, scale_y, 1.0);
-		glRotated(rad2deg(orientation), 0, 0, 1);
-		set_color(attr->foreground_color, attr->bold);
-		draw_char(attr->conceal ? '*' : c);
-		glEnd();
-	glPopMatrix();
-	if(BACKGROUND_ON)
-		draw_rectangle_filled(x, y, 1.20, 1.55, attr->background_color);
-}
-
-static int draw_vt100_block(double x, double y, double scale_x, double scale_y, double orientation, const uint8_t *msg, size_t len, vt100_attribute_t *attr, bool blink)
-{
-	scale_t scale = font_attributes();
-	double char_width = (scale.x / X_MAX)*1.1;
-	for(size_t i = 0; i < len; i++)
-		draw_vt100_char(x+char_width*i, y, scale_x, scale_y, orientation, msg[i], &attr[i], blink);
-	return len;
-}
-
-static int draw_block_scaled(double x, double y, double scale_x, double scale_y, double orientation, const uint8_t *msg, size_t len, color_t color)
-{
-	assert(msg);
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-		glLoadIdentity();
-		glTranslatef(x, y, 0.0);
-		glScaled(scale_x, scale_y, 1.0);
-		glRotated(rad2deg(orientation), 0, 0, 1);
-		set_color(color, true);
-		for(size_t i = 0; i < len; i++) {
-			uint8_t c = msg[i];
-			c = c >= 32 && c <= 127 ? c : '?';
-			glutStrokeCharacter(world.font_scaled, c);
+/**@brief move the cursor forward to 'cursor', a row at a time, moving
+ * down off the bottom margin scrolls the scroll region and the cursor stays
+ * where it is, as it does at the bottom of the display */
+static void terminal_advance(vt100_t *t, size_t cursor)
+{
+	assert(t);
+	assert(cursor >= t->cursor);
+	for(size_t y = t->cursor / t->width; y < (cursor / t->width); y = t->cursor / t->width) {
+		if(y == (t->scroll_bottom - 1u)) {
+			const size_t row = terminal_row(t, t->scroll_top) * t->width;
+			if(!t->scroll_top && !t->alternate) /* only rows leaving the top of the display are kept */
+				terminal_scrollback_push(t, &t->m[row], &t->attributes[row], t->wrapped[row / t->width]);
+			terminal_scroll(t, t->scroll_top, t->scroll_bottom, 1, true);
+			cursor -= t->width;
+		} else if(y == (t->height - 1u)) {
+			cursor -= t->width;
+		} else {
+			t->cursor += t->width;
 		}
-		glEnd();
-	glPopMatrix();
-	return len;
+	}
+	t->cursor = cursor;
 }
 
-static int draw_string_scaled(double x, double y, double scale_x, double scale_y, double orientation, const char *msg, color_t color)
+static void terminal_clear(vt100_t *t)
 {
-	assert(msg);
-	return draw_block_scaled(x, y, scale_x, scale_y, orientation, (uint8_t*)msg, strlen(msg), color);
+	assert(t);
+	t->parameter_count    = 0;
+	t->intermediate_count = 0;
+	t->private_marker     = 0;
+	memset(t->parameters, 0, sizeof(t->parameters));
 }
 
-static int vdraw_text(color_t color, double x, double y, const char *fmt, va_list ap)
+/**@brief get parameter 'i' of the sequence, or 'otherwise' if it was not
+ * given or was zero */
+static unsigned terminal_parameter(const vt100_t *t, unsigned i, unsigned otherwise)
 {
-	char f;
-	int r = 0;
-	assert(fmt);
-	static const double scale_x = 0.011;
-	static const double scale_y = 0.011;
-
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-	set_color(color, true);
-	glTranslatef(x, y, 0);
-	glScaled(scale_x, scale_y, 1.0);
-	while(*fmt) {
-		if('%' != (f = *fmt++)) {
-			glutStrokeCharacter(world.font_scaled, f);
-			r++;
-			continue;
-		}
-		switch(f = *fmt++) {
-		case 'c':
-		{
-			char x[2] = {0, 0};
-			x[0] = va_arg(ap, int);
-			r += draw_string(x);
-			break;
-		}
-		case 's':
-		{
-			char *s = va_arg(ap, char*);
-			r += draw_string(s);
-			break;
-		}
-		case 'x':
-		{
-			unsigned d = va_arg(ap, unsigned);
-			char s[64] = {0};
-			sprintf(s, "%04x", d);
-			r += draw_string(s);
-			break;
-		}
-		case 'u':
-		case 'd':
-		{
-			int d = va_arg(ap, int);
-			char s[64] = {0};
-			sprintf(s, f == 'u' ? "%u": "%d", d);
-			r += draw_string(s);
-			break;
-		}
-		case 'f':
-		{
-			double f = va_arg(ap, double);
-			char s[512] = {0};
-			sprintf(s, "%.2f", f);
-			r += draw_string(s);
-			break;
-		}
-		case 0:
-		default:
-			fatal("invalid format specifier '%c'", f);
-		}
+	assert(t);
+	const unsigned n = MIN(t->parameter_count, VT100_PARAMETERS);
+	return (i < n && t->parameters[i]) ? t->parameters[i] : otherwise;
+}
 
+static void terminal_param(vt100_t *t, uint8_t c)
+{
+	assert(t);
+	if(!(t->parameter_count))
+		t->parameter_count = 1;
+	if(t->parameter_count > VT100_PARAMETERS)
+		return;
+	if(c == ';') {
+		t->parameter_count++;
+		return;
 	}
-	glPopMatrix();
-	return r;
+	uint16_t *p = &t->parameters[t->parameter_count - 1];
+	*p = MIN((*p * 10u) + (c - '0'), VT100_PARAMETER_MAX);
 }
 
-static void fill_textbox(textbox_t *t, const char *fmt, ...)
+static void terminal_collect(vt100_t *t, uint8_t c)
 {
-	double r;
-	va_list ap;
 	assert(t);
-	assert(fmt);
-
-	scale_t scale = font_attributes();
-	double char_width = scale.x / X_MAX;
-	double char_height = scale.y / Y_MAX;
-	assert(t && fmt);
-	va_start(ap, fmt);
-	r = vdraw_text(t->color_text, t->x, t->y - t->height, fmt, ap);
-	r *= char_width * 1.11;
-	r += 1;
-	va_end(ap);
-	t->width = MAX(t->width, r);
-	t->height += (char_height); /*correct?*/
+	if(c >= 0x3C && c <= 0x3F) {
+		t->private_marker = c;
+		return;
+	}
+	if(t->intermediate_count < VT100_INTERMEDIATES)
+		t->intermediates[t->intermediate_count] = c;
+	t->intermediate_count = MIN(t->intermediate_count + 1, VT100_INTERMEDIATES + 1);
 }
 
-/*static void draw_textbox(textbox_t *t)
+/**@brief a character printed in the last column leaves the cursor on it
+ * with a wrap pending, as a VT100 does, so that a line that exactly fills a
+ * row and then a CR LF does not leave a blank row, the next character
+ * printed marks the row as wrapped and moves to the start of the next one */
+static void terminal_wrap(vt100_t *t)
 {
 	assert(t);
-	scale_t scale = font_attributes();
-	double char_height = scale.y / Y_MAX;
-	if(!(t->draw_border))
+	if(!t->wrap_pending)
 		return;
-	draw_rectangle_line(t->x - LINE_WIDTH, t->y - t->height + char_height - 1, t->width, t->height + 1, LINE_WIDTH, t->color_box);
-}*/
+	t->wrap_pending = false;
+	t->wrapped[terminal_row(t, t->cursor / t->width)] = true;
+	terminal_advance(t, ((t->cursor / t->width) + 1) * t->width);
+}
 
-static fifo_t *fifo_new(size_t size)
+/**@brief move the cursor on after 'n' cells have been printed, stopping
+ * on the last column of the row with a wrap pending */
+static void terminal_printed(vt100_t *t, size_t n)
 {
-	assert(size >= 2); /* It does not make sense to have a FIFO less than this size */
-	fifo_data_t *buffer = allocate_or_die(size * sizeof(buffer[0]));
-	fifo_t *fifo = allocate_or_die(sizeof(fifo_t));
+	assert(t);
+	assert(n && (t->cursor % t->width) + n <= t->width);
+	if((t->cursor % t->width) + n == t->width) {
+		t->cursor += n - 1;
+		t->wrap_pending = true;
+	} else {
+		t->cursor += n;
+	}
+}
 
-	fifo->buffer = buffer;
-	fifo->head   = 0;
-	fifo->tail   = 0;
-	fifo->size   = size;
+static void terminal_print(vt100_t *t, uint8_t c)
+{
+	assert(t);
+	terminal_wrap(t);
+	const size_t i = terminal_cell(t, t->cursor);
+	t->m[i] = c;
+	t->attributes[i] = t->attribute;
+	terminal_damage(t, t->cursor, 1);
+	terminal_printed(t, 1);
+}
 
-	return fifo;
+static void terminal_execute(vt100_t *t, uint8_t c)
+{
+	assert(t);
+	if(c != BELL)
+		t->wrap_pending = false;
+	switch(c) {
+	case '\t': /* next tab stop, every eight columns, but no further than the last */
+	{
+		const size_t x = t->cursor % t->width;
+		t->cursor += MIN(((x / 8) + 1) * 8, t->width - 1u) - x;
+		break;
+	}
+	case '\r':
+		t->cursor = (t->cursor / t->width) * t->width;
+		break;
+	case '\n':
+	case '\v':
+	case '\f':
+		terminal_advance(t, ((t->cursor / t->width) + 1) * t->width);
+		break;
+	case DELETE:
+	case BACKSPACE: /* only moves, 'cub1' in the vt100 terminfo entry */
+		terminal_at_xy_relative(t, -1, 0, true);
+		break;
+	default: /* BEL and the rest are ignored */
+		return;
+	}
 }
 
-static void fifo_free(fifo_t *fifo)
+static void terminal_esc_dispatch(vt100_t *t, uint8_t c)
 {
-	if(!fifo)
+	assert(t);
+	if(t->intermediate_count) /* character set selection and the like */
 		return;
-	free(fifo->buffer);
-	free(fifo);
+	t->wrap_pending = false;
+	switch(c) {
+	case '7': t->cursor_saved = t->cursor; break; /* DECSC */
+	case '8': t->cursor = t->cursor_saved; break; /* DECRC */
+	case 'D': terminal_advance(t, t->cursor + t->width); break; /* IND */
+	case 'E': terminal_execute(t, '\r'); terminal_execute(t, '\n'); break; /* NEL */
+	case 'M': /* RI, up a row, scrolling the region down at its top margin */
+		if((t->cursor / t->width) == t->scroll_top)
+			terminal_scroll(t, t->scroll_top, t->scroll_bottom, 1, false);
+		else
+			terminal_at_xy_relative(t, 0, -1, true);
+		break;
+	}
 }
 
-static bool fifo_is_full(fifo_t * fifo)
+/**@brief exchange the cells of the normal and alternate screens, only
+ * the pointers move */
+static void terminal_screen_swap(vt100_t *t)
 {
-	assert(fifo);
-	return (fifo->head == (fifo->size - 1) && fifo->tail == 0)
-	    || (fifo->head == (fifo->tail - 1));
+	assert(t);
+	vt100_screen_t swap = t->other;
+	t->other.m          = t->m;
+	t->other.attributes = t->attributes;
+	t->other.wrapped    = t->wrapped;
+	t->other.rows       = t->rows;
+	t->other.top        = t->top;
+	t->m          = swap.m;
+	t->attributes = swap.attributes;
+	t->wrapped    = swap.wrapped;
+	t->rows       = swap.rows;
+	t->top        = swap.top;
+	t->alternate  = !t->alternate;
+	terminal_damage(t, 0, t->size);
 }
 
-static bool fifo_is_empty(fifo_t * fifo)
+/**@brief switch to or from the alternate screen, 'save' stores the cursor
+ * on the way in and restores it on the way out (1049), 'clear' blanks the
+ * alternate screen on the way in (1047 and 1049) */
+static void terminal_alternate(vt100_t *t, bool set, bool save, bool clear)
 {
-	assert(fifo);
-	return fifo->head == fifo->tail;
+	assert(t);
+	if(set == t->alternate)
+		return;
+	t->wrap_pending = false;
+	if(set && save)
+		t->cursor_alternate_saved = t->cursor;
+	terminal_screen_swap(t);
+	if(set && clear)
+		terminal_erase(t, 0, t->size);
+	if(!set && save)
+		t->cursor = t->cursor_alternate_saved;
 }
 
-static size_t fifo_count(fifo_t * fifo)
+/**@brief set or reset the DEC private modes given as parameters */
+static void terminal_mode(vt100_t *t, bool set)
 {
-	assert(fifo);
-	if (fifo_is_empty(fifo))
-		return 0;
-	else if (fifo_is_full(fifo))
-		return fifo->size;
-	else if (fifo->head < fifo->tail)
-		return fifo->head + (fifo->size - fifo->tail);
-	else
-		return fifo->head - fifo->tail;
+	assert(t);
+	for(unsigned i = 0; i < MIN(t->parameter_count, VT100_PARAMETERS); i++) {
+		switch(t->parameters[i]) {
+		case 1:    t->cursor_keys = set; break; /* DECCKM */
+		case 25:   t->cursor_on = set; break; /* DECTCEM */
+		case 47:   terminal_alternate(t, set, false, false); break;
+		case 1047: terminal_alternate(t, set, false, true);  break;
+		case 1049: terminal_alternate(t, set, true,  true);  break;
+		}
+	}
 }
 
-static size_t fifo_push(fifo_t * fifo, fifo_data_t data)
+static void terminal_csi_dispatch(vt100_t *t, uint8_t c)
 {
-	assert(fifo);
+	assert(t);
+	const unsigned n = terminal_parameter(t, 0, 1);
+	if(t->intermediate_count)
+		return;
+	if(t->private_marker == '?' && (c == 'h' || c == 'l'))
+		terminal_mode(t, c == 'h');
+	if(t->private_marker)
+		return;
+	if(c != 'm') /* everything else moves the cursor or the cells under it */
+		t->wrap_pending = false;
+
+	switch(c) {
+	case 'A': terminal_at_xy_relative(t,  0, -n, true); break; /* relative cursor up */
+	case 'B': terminal_at_xy_relative(t,  0,  n, true); break; /* relative cursor down */
+	case 'C': terminal_at_xy_relative(t,  n,  0, true); break; /* relative cursor forward */
+	case 'D': terminal_at_xy_relative(t, -n,  0, true); break; /* relative cursor back */
+	case 'E': terminal_at_xy_relative(t, -terminal_x_current(t),  n, true); break; /* down n lines, to the beginning */
+	case 'F': terminal_at_xy_relative(t, -terminal_x_current(t), -n, true); break; /* up n lines, to the beginning */
+	case 'G': terminal_at_xy(t, n - 1, terminal_y_current(t), true); break; /* move the cursor to column n */
+	case 'H':
+	case 'f': /* move the cursor to row n, column m, counting from one */
+		terminal_at_xy(t, terminal_parameter(t, 1, 1) - 1, n - 1, true);
+		break;
+	case 'J': /* erase in display */
+		switch(terminal_parameter(t, 0, 0)) {
+		case 0: terminal_erase(t, t->cursor, t->size - t->cursor); break; /* to the end */
+		case 1: terminal_erase(t, 0, t->cursor + 1); break; /* from the beginning */
+		case 2:
+		case 3: terminal_erase(t, 0, t->size); break;
+		}
+		break;
+	case 'K': /* erase in line */
+	{
+		const size_t x = terminal_x_current(t), line = t->cursor - x;
+		switch(terminal_parameter(t, 0, 0)) {
+		case 0: terminal_erase(t, t->cursor, t->width - x); break; /* to the end */
+		case 1: terminal_erase(t, line, x + 1); break; /* from the beginning */
+		case 2: terminal_erase(t, line, t->width); break;
+		}
+		break;
+	}
+	case 'L': terminal_lines(t, n, true);  break; /* insert lines */
+	case 'M': terminal_lines(t, n, false); break; /* delete lines */
+	case 'S': terminal_scroll(t, t->scroll_top, t->scroll_bottom, n, true);  break; /* scroll up */
+	case 'T': terminal_scroll(t, t->scroll_top, t->scroll_bottom, n, false); break; /* scroll down */
+	case '@': terminal_shift(t, n, true);  break; /* insert characters */
+	case 'P': terminal_shift(t, n, false); break; /* delete characters */
+	case 'X': terminal_erase(t, t->cursor, MIN(n, t->width - terminal_x_current(t))); break; /* erase characters */
+	case 'm': terminal_sgr(t); break; /* set attributes */
+	case 'r': /* DECSTBM, set the scroll region to rows n to m, counting from one */
+	{
+		const unsigned top = n - 1, bottom = MIN(terminal_parameter(t, 1, t->height), t->height);
+		if((top + 1) >= bottom) /* a region must be at least two rows */
+			break;
+		t->scroll_top    = top;
+		t->scroll_bottom = bottom;
+		t->cursor        = 0;
+		break;
+	}
+	case 's': t->cursor_saved = t->cursor; break;
+	case 'u': t->cursor = t->cursor_saved; break;
+	case 'i': /* AUX Port On == 5, AUX Port Off == 4 */
+		break;
+	case 'n': /* Device Status Report */
+		/** @note This should transmit to the H2 system the
+		 * following "ESC[n;mR", where n is the row and m is the column,
+		 * we're not going to do this, although pty_write() could
+		 * be used to do this */
+		break;
+	}
+}
 
-	if (fifo_is_full(fifo))
-		return 0;
+static void terminal_osc_put(vt100_t *t, uint8_t c)
+{
+	assert(t);
+	if(t->osc_length < (VT100_OSC_LENGTH - 1))
+		t->osc[t->osc_length++] = c;
+}
 
-	fifo->buffer[fifo->head] = data;
+/**@brief act on a complete operating system command, only setting the
+ * title is supported */
+static void terminal_osc_end(vt100_t *t)
+{
+	assert(t);
+	t->osc[t->osc_length] = '\0';
+	if((t->osc[0] == '0' || t->osc[0] == '2') && t->osc[1] == ';')
+		memcpy(t->title, &t->osc[2], t->osc_length - 1);
+	t->osc_length = 0;
+}
 
-	fifo->head++;
-	if (fifo->head == fifo->size)
-		fifo->head = 0;
+static void terminal_action(vt100_t *t, terminal_action_t action, uint8_t c)
+{
+	switch(action) {
+	case TERMINAL_ACTION_NONE:                                 break;
+	case TERMINAL_ACTION_PRINT:        terminal_print(t, c);        break;
+	case TERMINAL_ACTION_EXECUTE:      terminal_execute(t, c);      break;
+	case TERMINAL_ACTION_COLLECT:      terminal_collect(t, c);      break;
+	case TERMINAL_ACTION_PARAM:        terminal_param(t, c);        break;
+	case TERMINAL_ACTION_ESC_DISPATCH: terminal_esc_dispatch(t, c); break;
+	case TERMINAL_ACTION_CSI_DISPATCH: terminal_csi_dispatch(t, c); break;
+	case TERMINAL_ACTION_PUT: /* device control strings are not supported */ break;
+	case TERMINAL_ACTION_OSC_PUT:      terminal_osc_put(t, c);      break;
+	default:
+		fatal("invalid parser action: %u", (unsigned)action);
+	}
+}
 
-	return 1;
+static void terminal_update(vt100_t *t, uint8_t c)
+{
+	const uint8_t transition = terminal_transitions[t->state][terminal_classes[c]];
+	const unsigned next = transition & 0xF;
+	if(next == TERMINAL_STAY) {
+		terminal_action(t, transition >> 4, c);
+		return;
+	}
+	/* exit actions, an OSC is applied if it ends with BEL or ST, which is
+	 * ESC '\\', and is thrown away if it is cancelled or anything else */
+	if(t->state == TERMINAL_OSC_STRING && c != ESCAPE) {
+		if(c == BELL)
+			terminal_osc_end(t);
+		t->osc_length = 0;
+	}
+	if(t->state == TERMINAL_ESCAPE && t->osc_length) {
+		if(c == '\\')
+			terminal_osc_end(t);
+		t->osc_length = 0;
+	}
+	terminal_action(t, transition >> 4, c);
+	t->state = next;
+	switch(next) { /* entry actions */
+	case TERMINAL_ESCAPE:
+	case TERMINAL_CSI_ENTRY:
+	case TERMINAL_DCS_ENTRY:
+		terminal_clear(t);
+		break;
+	case TERMINAL_OSC_STRING:
+		t->osc_length = 0;
+		break;
+	}
 }
 
-static size_t fifo_pop(fifo_t * fifo, fifo_data_t * data)
+void vt100_update(vt100_t *t, uint8_t c)
 {
-	assert(fifo);
-	assert(data);
+	assert(t);
+	assert(t->m);
+	terminal_update(t, c);
+}
 
-	if (fifo_is_empty(fifo))
-		return 0;
+/* The scanners below find the first control byte in a buffer, everything
+ * before it would be printed by the parser in the ground state and can be
+ * copied onto the screen as is. The SIMD versions test a whole vector of
+ * input at once, a byte is a control byte if its top three bits are clear
+ * or it is DELETE. The best one for the CPU we are running on is picked the
+ * first time terminal_scan() is called. */
 
-	*data = fifo->buffer[fifo->tail];
+typedef size_t (*terminal_scanner_t)(const uint8_t *buf, size_t len);
 
-	fifo->tail++;
-	if (fifo->tail == fifo->size)
-		fifo->tail = 0;
+static size_t terminal_scan_scalar(const uint8_t *buf, size_t len)
+{
+	size_t i = 0;
+	for(; i < len; i++)
+		if(terminal_is_control(buf[i]))
+			break;
+	return i;
+}
 
-	return 1;
+#ifdef TERMINAL_SCAN_X86
+__attribute__((target("sse2")))
+static size_t terminal_scan_sse2(const uint8_t *buf, size_t len)
+{
+	const __m128i high = _mm_set1_epi8((char)0xE0), zero = _mm_setzero_si128();
+	const __m128i del  = _mm_set1_epi8(DELETE);
+	size_t i = 0;
+	for(; (i + 16) <= len; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)&buf[i]);
+		const __m128i m = _mm_or_si128(_mm_cmpeq_epi8(_mm_and_si128(v, high), zero), _mm_cmpeq_epi8(v, del));
+		const unsigned mask = _mm_movemask_epi8(m);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + terminal_scan_scalar(&buf[i], len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t terminal_scan_avx2(const uint8_t *buf, size_t len)
+{
+	const __m256i high = _mm256_set1_epi8((char)0xE0), zero = _mm256_setzero_si256();
+	const __m256i del  = _mm256_set1_epi8(DELETE);
+	size_t i = 0;
+	for(; (i + 32) <= len; i += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)&buf[i]);
+		const __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_and_si256(v, high), zero), _mm256_cmpeq_epi8(v, del));
+		const unsigned mask = _mm256_movemask_epi8(m);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + terminal_scan_sse2(&buf[i], len - i);
 }
+#endif
 
+static terminal_scanner_t terminal_scanner_select(const char **name)
+{
+	assert(name);
+#ifdef TERMINAL_SCAN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		*name = "avx2";
+		return terminal_scan_avx2;
+	}
+	if(__builtin_cpu_supports("sse2")) {
+		*name = "sse2";
+		return terminal_scan_sse2;
+	}
+#endif
+	*name = "scalar";
+	return terminal_scan_scalar;
+}
 
-/* ====================================== Utility Functions ==================================== */
+static size_t terminal_scan_dispatch(const uint8_t *buf, size_t len);
+static terminal_scanner_t terminal_scan = terminal_scan_dispatch;
+static const char *terminal_scan_name = "none";
 
-/* ====================================== Simulator Objects ==================================== */
+static size_t terminal_scan_dispatch(const uint8_t *buf, size_t len)
+{
+	terminal_scan = terminal_scanner_select(&terminal_scan_name);
+	debug("control byte scanner: %s", terminal_scan_name);
+	return terminal_scan(buf, len);
+}
 
+/**@brief the name of the scanner vt100_write() uses on this machine */
+const char *vt100_scanner(void)
+{
+	if(terminal_scan == terminal_scan_dispatch)
+		terminal_scan = terminal_scanner_select(&terminal_scan_name);
+	return terminal_scan_name;
+}
 
-#define TERMINAL_WIDTH       (80)
-#define TERMINAL_HEIGHT      (10)
-#define TERMINAL_SIZE        (TERMINAL_WIDTH*TERMINAL_HEIGHT)
+/**@brief process a block of output in one go, runs of printable characters
+ * are copied straight into the screen buffer, only control characters and
+ * escape sequences go through the byte at a time state machine. The result
+ * is identical to calling vt100_update() on each byte. */
+void vt100_write(vt100_t *t, const uint8_t *buf, size_t len)
+{
+	assert(t);
+	assert(t->m);
+	assert(buf || !len);
 
-typedef struct {
-	unsigned width;
-	unsigned height;
-	GLuint name;
-	uint8_t *image;
-} vt100_background_texture_t;
+	for(size_t i = 0; i < len;) {
+		if(t->state != TERMINAL_GROUND || terminal_is_control(buf[i])) {
+			terminal_update(t, buf[i++]);
+			continue;
+		}
 
-typedef struct {
-	uint64_t blink_count;
-	double x;
-	double y;
-	bool blink_on;
-	color_t color;
-	vt100_t vt100;
-	vt100_background_texture_t *texture;
-} terminal_t;
+		const size_t run = i + terminal_scan(&buf[i], len - i);
+
+		while(i < run) { /* a row at a time, a run may scroll the screen more than once */
+			terminal_wrap(t);
+			const size_t cell = terminal_cell(t, t->cursor);
+			const size_t n = MIN(run - i, t->width - (t->cursor % t->width));
+			memcpy(&t->m[cell], &buf[i], n);
+			terminal_attribute_block_set(t, cell, n, t->attribute);
+			terminal_damage(t, t->cursor, n);
+			terminal_printed(t, n);
+			i += n;
+		}
+	}
+}
 
-static void texture_background(terminal_t *t)
+/**@brief size the cache of expanded lines, and the lines pushed from
+ * now on, to fit the display */
+static void terminal_scrollback_cache(vt100_t *t)
 {
 	assert(t);
-	vt100_background_texture_t *v = t->texture;
-	vt100_t *vt = &t->vt100;
-	unsigned i, j;
-	uint8_t *img = v->image;
-	const unsigned h = v->height;
-	const unsigned w = v->width;
-
-	for (i = 0; i < h; i++) {
-		uint8_t *row = &img[i*4];
-		unsigned ii = ((h - i - 1)*vt->height) / h;
-		for (j = 0; j < w; j++) {
-			uint8_t *column = &row[j*h*4];
-			const unsigned jj = (vt->width*j) / w;
-			const unsigned idx = jj+(ii*vt->width);
-			column[0] = 255 * (vt->attributes[idx].background_color & 1);
-			column[1] = 255 * (vt->attributes[idx].background_color & 2);
-			column[2] = 255 * (vt->attributes[idx].background_color & 4);
-			column[3] = 255;
-		}
+	vt100_scrollback_t *s = &t->scrollback;
+	assert(t->width <= UINT16_MAX); /* a line has at most that many runs */
+	assert(((t->width * (sizeof(vt100_run_t) + 1)) + sizeof(vt100_run_t)) <= VT100_SEGMENT_SIZE);
+	free(s->m);
+	free(s->attributes);
+	free(s->cached);
+	s->width      = t->width;
+	s->slots      = t->height;
+	s->m          = allocate_or_die(s->slots * t->width);
+	s->attributes = allocate_or_die(s->slots * t->width * sizeof(s->attributes[0]));
+	s->cached     = allocate_or_die(s->slots * sizeof(s->cached[0]));
+	for(size_t i = 0; i < s->slots; i++)
+		s->cached[i] = SIZE_MAX;
+}
+
+/**@brief discard the scrollback and set it up again to hold 'lines'
+ * lines, with the arena on the heap or, if 'fd' is not negative, in that
+ * file */
+static void terminal_scrollback_allocate(vt100_t *t, size_t lines, int fd)
+{
+	assert(t);
+	vt100_scrollback_t *s = &t->scrollback;
+	for(size_t i = s->unmapped; i < s->segments; i++)
+		munmap(s->segment[i % s->segments_max], VT100_SEGMENT_SIZE);
+	if(s->fd >= 0) {
+		if(s->index)
+			munmap(s->index, terminal_index_size(s->lines));
+		close(s->fd);
+	} else {
+		free(s->index);
 	}
+	free(s->segment);
+	free(s->place);
+	free(s->arena);
+	free(s->m);
+	free(s->attributes);
+	free(s->cached);
+	memset(s, 0, sizeof(*s));
+	s->fd = fd;
+	if(!lines)
+		return;
+	s->lines = lines;
+	if(fd >= 0)
+		terminal_index_map(s);
+	terminal_scrollback_cache(t);
 }
 
-/* See <http://www.glprogramming.com/red/chapter09.html> */
-static void draw_texture(terminal_t *t, bool update)
+/**@brief drop the newest 'lines' lines of the scrollback, the space they
+ * took in the arena is used again */
+static void terminal_scrollback_pop(vt100_scrollback_t *s, size_t lines)
 {
-	vt100_background_texture_t *v = t->texture;
-	if(!v)
+	assert(s);
+	assert(lines <= s->count);
+	if(!lines)
 		return;
+	s->arena_used = terminal_scrollback_index(s, s->count - lines)->offset;
+	s->head       = (s->head + s->capacity - lines) % s->capacity;
+	s->count     -= lines;
+	s->pushed    -= lines;
+}
 
-	scale_t scale = font_attributes();
-	double char_width  = scale.x / X_MAX;
-       	double char_height = scale.y / Y_MAX;
-	double x = t->x;
-	double y = t->y - (char_height * (t->vt100.height-1.0));
-	double width  = char_width  * t->vt100.width * 1.10;
-	double height = char_height * t->vt100.height;
-
-	glEnable(GL_TEXTURE_2D);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
-
-	if(update) {
-		glClearColor (0.0, 0.0, 0.0, 0.0);
-		glShadeModel(GL_FLAT);
-		glEnable(GL_DEPTH_TEST);
-
-		texture_background(t);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-		glGenTextures(1, &v->name);
-		glBindTexture(GL_TEXTURE_2D, v->name);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, v->width, v->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, v->image);
-	}
+/**@brief set the number of lines kept in the scrollback, zero disables it,
+ * any lines already held are discarded */
+void vt100_scrollback(vt100_t *t, size_t lines)
+{
+	terminal_scrollback_allocate(t, lines, -1);
+}
 
-	glBindTexture(GL_TEXTURE_2D, v->name);
-	glMatrixMode(GL_MODELVIEW);
-	glBegin(GL_QUADS);
-		glTexCoord2f(1.0, 0.0); glVertex3f(x,       y+height, 0.0);
-		glTexCoord2f(1.0, 1.0); glVertex3f(x+width, y+height, 0.0);
-		glTexCoord2f(0.0, 1.0); glVertex3f(x+width, y,        0.0);
-		glTexCoord2f(0.0, 0.0); glVertex3f(x,       y,        0.0);
-	glEnd();
-	glDisable(GL_TEXTURE_2D);
+/**@brief keep the scrollback, and its index, in 'file' instead of on the
+ * heap, holding up to 'lines' lines. The file is created, or emptied, and
+ * removed straight away so it goes when the terminal does. Its pages are
+ * reclaimed by the operating system under memory pressure like those of any
+ * other file. Segments that only held dropped lines are unmapped and their
+ * place in the file used again, so it stays about as big as the lines held
+ * plus sizeof(vt100_line_t) bytes a line for the index. Any lines already
+ * held are discarded. */
+void vt100_scrollback_file(vt100_t *t, const char *file, size_t lines)
+{
+	assert(t);
+	assert(file);
+	assert(lines);
+	errno = 0;
+	const int fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if(fd < 0)
+		fatal("failed to open scrollback file '%s': %s", file, reason());
+	if(unlink(file) < 0)
+		warning("failed to remove scrollback file '%s': %s", file, reason());
+	terminal_scrollback_allocate(t, lines, fd);
 }
 
-void draw_terminal(const world_t *world, terminal_t *t, char *name)
+/**@brief look up row 'y' of the display as it appears when scrolled 'back'
+ * lines into the scrollback, 'back' is limited to the lines held */
+bool vt100_row(vt100_t *t, size_t back, unsigned y, const uint8_t **m, const vt100_attribute_t **attributes)
 {
-	assert(world);
 	assert(t);
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-
-	static const double scale_x = 0.011;
-	static const double scale_y = 0.011;
-	vt100_t *v = &t->vt100;
-	double now = world->tick - t->blink_count;
-	scale_t scale = font_attributes();
-	double char_width  = scale.x / X_MAX;
-       	double char_height = scale.y / Y_MAX;
-	size_t cursor_x = v->cursor % v->width;
-	size_t cursor_y = v->cursor / v->width;
-
-	if(now > seconds_to_ticks(world, 1.0)) {
-		t->blink_on = !(t->blink_on);
-		t->blink_count = world->tick;
+	assert(m);
+	assert(attributes);
+	vt100_scrollback_t *s = &t->scrollback;
+	back = MIN(back, s->count);
+	if(y >= t->height)
+		return false;
+	if(y < back) {
+		terminal_scrollback_line(s, s->count - (back - y), m, attributes, NULL);
+		return true;
 	}
+	const size_t row = terminal_row(t, y - back) * t->width;
+	*m          = &t->m[row];
+	*attributes = &t->attributes[row];
+	return true;
+}
+
+/**@brief get the bounding box of everything that has changed on the
+ * display since vt100_damage_clear(), returns false if nothing has. Cursor
+ * movement on its own is not damage. */
+bool vt100_damaged(const vt100_t *t, vt100_damage_t *damage)
+{
+	assert(t);
+	if(damage)
+		*damage = t->damage;
+	return t->damage.x0 < t->damage.x1;
+}
+
+bool vt100_row_dirty(const vt100_t *t, unsigned y)
+{
+	assert(t);
+	assert(y < t->height);
+	return t->dirty[y];
+}
 
-	/**@note the cursor is deliberately in a different position compared to draw_vga(), due to how the VGA cursor behaves in hardware */
-	if((!(v->blinks) || t->blink_on) && v->cursor_on) /* fudge factor of 1.10? */
-		draw_rectangle_filled(t->x + (char_width * 1.10 * (cursor_x)) , t->y - (char_height * cursor_y), char_width, char_height, WHITE);
+void vt100_damage_all(vt100_t *t)
+{
+	assert(t);
+	terminal_damage(t, 0, t->size);
+}
+
+void vt100_damage_clear(vt100_t *t)
+{
+	assert(t);
+	memset(t->dirty, 0, t->height);
+	memset(&t->damage, 0, sizeof(t->damage));
+}
 
+static void terminal_screen_free(vt100_screen_t *s)
+{
+	assert(s);
+	free(s->m);
+	free(s->attributes);
+	free(s->wrapped);
+	free(s->rows);
+	memset(s, 0, sizeof(*s));
+}
 
-	for(size_t i = 0; i < t->vt100.height; i++)
-		draw_vt100_block(t->x, t->y - ((double)i * char_height), scale_x, scale_y, 0, v->m + (i*v->width), v->width, v->attributes + (i*v->width), t->blink_on);
-	draw_string_scaled(t->x, t->y - (v->height * char_height), scale_x, scale_y, 0, name, t->color);
+static void terminal_screen_allocate(vt100_screen_t *s, unsigned width, unsigned height)
+{
+	assert(s);
+	const size_t size = width * height;
+	s->top        = 0;
+	s->m          = allocate_or_die(size);
+	s->attributes = allocate_or_die(size * sizeof(s->attributes[0]));
+	s->wrapped    = allocate_or_die(height);
+	s->rows       = allocate_or_die(height * sizeof(s->rows[0]));
+	memset(s->m, ' ', size);
+	for(size_t i = 0; i < size; i++)
+		s->attributes[i] = vt100_default_attribute;
+	for(unsigned y = 0; y < height; y++)
+		s->rows[y] = y;
+}
 
-	/* fudge factor = 1/((1/scale_x)/X_MAX) ??? */
+/**@brief allocate both screens, blank, the normal screen is left current */
+static void terminal_cells_allocate(vt100_t *t, unsigned width, unsigned height)
+{
+	assert(t);
+	assert(width && height);
+	if(t->alternate)
+		terminal_screen_swap(t);
+	vt100_screen_t current = { .m = t->m, .attributes = t->attributes, .wrapped = t->wrapped, .rows = t->rows };
+	terminal_screen_free(&current);
+	terminal_screen_free(&t->other);
+	free(t->dirty);
+	t->width      = width;
+	t->height     = height;
+	t->size       = width * height;
+	terminal_screen_allocate(&current, width, height);
+	terminal_screen_allocate(&t->other, width, height);
+	t->top        = current.top;
+	t->m          = current.m;
+	t->attributes = current.attributes;
+	t->wrapped    = current.wrapped;
+	t->rows       = current.rows;
+	t->dirty      = allocate_or_die(t->height);
+	t->scroll_top    = 0;
+	t->scroll_bottom = t->height;
+	memset(&t->damage, 0, sizeof(t->damage));
+	terminal_damage(t, 0, t->size);
+}
 
-	glPopMatrix();
+vt100_t *vt100_new(unsigned width, unsigned height, size_t scrollback)
+{
+	vt100_t *t = allocate_or_die(sizeof(*t));
+	t->state     = TERMINAL_GROUND;
+	t->cursor_on = true;
+	t->blinks    = false;
+	t->attribute = vt100_default_attribute;
+	t->scrollback.fd = -1;
+	terminal_cells_allocate(t, width, height);
+	vt100_scrollback(t, scrollback);
+	return t;
+}
 
-	draw_rectangle_line(t->x, t->y - (char_height * (v->height-1.0)), char_width * v->width * 1.10, char_height * v->height, LINE_WIDTH, t->color);
+void vt100_free(vt100_t *t)
+{
+	if(!t)
+		return;
+	vt100_scrollback(t, 0);
+	free(t->m);
+	free(t->attributes);
+	free(t->wrapped);
+	free(t->dirty);
+	free(t->rows);
+	terminal_screen_free(&t->other);
+	free(t);
 }
 
-/* ====================================== Simulator Objects ==================================== */
+/* Resizing reflows the text, the scrollback and the rows of the screen that
+ * are in use are joined back up into the lines they were written as (using
+ * the 'wrapped' flags), trailing blanks are dropped and the lines are then
+ * wrapped again at the new width. The bottom of the result becomes the new
+ * screen and what does not fit goes back into the scrollback. */
 
-/* ====================================== Simulator Instances ================================== */
+typedef struct {
+	uint8_t *m;
+	vt100_attribute_t *attributes;
+	uint8_t *wrapped;
+	size_t rows, width;
+	size_t cursor_row, cursor_column;
+} terminal_reflow_t;
+
+static void terminal_reflow_row(vt100_t *t, size_t r, const uint8_t **m, const vt100_attribute_t **a, bool *wrapped)
+{
+	vt100_scrollback_t *s = &t->scrollback;
+	if(r < s->count) {
+		terminal_scrollback_line(s, r, m, a, wrapped);
+		return;
+	}
+	const size_t row = terminal_row(t, r - s->count);
+	*m       = &t->m[row * t->width];
+	*a       = &t->attributes[row * t->width];
+	*wrapped = t->wrapped[row];
+}
 
+static void terminal_reflow_line(terminal_reflow_t *r, const uint8_t *m, const vt100_attribute_t *a, size_t length, size_t cursor)
+{
+	const size_t first = r->rows;
+	size_t i = 0;
+	do {
+		const size_t n = MIN(length - i, r->width);
+		memcpy(&r->m[r->rows * r->width], &m[i], n);
+		memcpy(&r->attributes[r->rows * r->width], &a[i], n * sizeof(*a));
+		r->wrapped[r->rows] = (i + n) < length;
+		r->rows++;
+		i += n;
+	} while(i < length);
+	if(cursor != SIZE_MAX) {
+		r->cursor_row    = first + (cursor / r->width);
+		r->cursor_column = cursor % r->width;
+		if(r->cursor_row >= r->rows) {
+			r->wrapped[r->rows - 1] = true;
+			r->rows++;
+		}
+	}
+}
 
-#define VGA_TEXTURE_WIDTH  (256)
-#define VGA_TEXTURE_HEIGHT (256)
-static uint8_t vga_background_image[VGA_TEXTURE_WIDTH*VGA_TEXTURE_HEIGHT*4];
+void vt100_resize(vt100_t *t, unsigned width, unsigned height)
+{
+	assert(t);
+	assert(width && height);
+	vt100_scrollback_t *s = &t->scrollback;
+	const bool alternate = t->alternate;
+	t->wrap_pending = false;
+	if(alternate) { /* reflow the normal screen, the program will redraw the alternate one */
+		const size_t cursor = t->cursor;
+		terminal_screen_swap(t);
+		t->cursor = t->cursor_alternate_saved;
+		t->cursor_alternate_saved = cursor;
+	}
+	const size_t alternate_x = t->cursor_alternate_saved % t->width, alternate_y = t->cursor_alternate_saved / t->width;
+	const size_t saved_x = t->cursor_saved % t->width, saved_y = t->cursor_saved / t->width;
+	const size_t history = MIN(s->count, VT100_REFLOW_LINES), skip = s->count - history;
+	const size_t cursor_y = t->cursor / t->width, cursor_x = t->cursor % t->width;
+
+	size_t used = cursor_y + 1; /* rows below the cursor and the last text are not kept */
+	for(size_t y = used; y < t->height; y++) {
+		const size_t row = terminal_row(t, y) * t->width;
+		for(size_t x = 0; x < t->width; x++)
+			if(!terminal_blank(&t->m[row + x], &t->attributes[row + x])) {
+				used = y + 1;
+				break;
+			}
+	}
 
-static vt100_background_texture_t vga_background_texture = {
-	.width  = VGA_TEXTURE_WIDTH,
-	.height = VGA_TEXTURE_HEIGHT,
-	.name   = 0,
-	.image  = (uint8_t*)vga_background_image
-};
+	const size_t rows = history + used;
+	const size_t capacity = (rows * ((t->width + width - 1) / width)) + 1;
+	terminal_reflow_t r = {
+		.m          = allocate_or_die(capacity * width),
+		.attributes = allocate_or_die(capacity * width * sizeof(r.attributes[0])),
+		.wrapped    = allocate_or_die(capacity),
+		.width      = width,
+	};
+	memset(r.m, ' ', capacity * width);
+	for(size_t i = 0; i < (capacity * width); i++)
+		r.attributes[i] = vt100_default_attribute;
+	uint8_t *line_m          = allocate_or_die(rows * t->width);
+	vt100_attribute_t *line_a = allocate_or_die(rows * t->width * sizeof(line_a[0]));
+
+	for(size_t i = 0; i < rows;) {
+		size_t length = 0, cursor = SIZE_MAX;
+		bool wrapped = true;
+		for(; i < rows && wrapped; i++) {
+			const uint8_t *m = NULL;
+			const vt100_attribute_t *a = NULL;
+			terminal_reflow_row(t, skip + i, &m, &a, &wrapped);
+			if(i == (history + cursor_y))
+				cursor = length + cursor_x;
+			memcpy(&line_m[length], m, t->width);
+			memcpy(&line_a[length], a, t->width * sizeof(*a));
+			length += t->width;
+		}
+		while(length && terminal_blank(&line_m[length - 1], &line_a[length - 1]))
+			length--;
+		if(cursor != SIZE_MAX)
+			length = MAX(length, cursor);
+		terminal_reflow_line(&r, line_m, line_a, length, cursor);
+	}
+	assert(r.rows <= capacity);
+
+	size_t first = r.rows > height ? r.rows - height : 0;
+	first = MIN(first, r.cursor_row);
+
+	terminal_cells_allocate(t, width, height);
+	terminal_scrollback_pop(s, history);
+	if(s->lines)
+		terminal_scrollback_cache(t);
+	for(size_t i = 0; i < first; i++)
+		terminal_scrollback_push(t, &r.m[i * width], &r.attributes[i * width], r.wrapped[i]);
+	for(size_t y = 0; y < height && (first + y) < r.rows; y++) {
+		memcpy(&t->m[y * width], &r.m[(first + y) * width], width);
+		memcpy(&t->attributes[y * width], &r.attributes[(first + y) * width], width * sizeof(t->attributes[0]));
+		t->wrapped[y] = r.wrapped[first + y];
+	}
+	t->cursor       = ((r.cursor_row - first) * width) + r.cursor_column;
+	t->cursor_saved = (MIN(saved_y, height - 1u) * width) + MIN(saved_x, width - 1u);
+	t->cursor_alternate_saved = (MIN(alternate_y, height - 1u) * width) + MIN(alternate_x, width - 1u);
+	if(alternate) {
+		const size_t cursor = t->cursor;
+		terminal_alternate(t, true, false, false);
+		t->cursor = t->cursor_alternate_saved;
+		t->cursor_alternate_saved = cursor;
+	}
 
-static terminal_t vga_terminal = {
-	.blink_count = 0,
-	.x           = X_MIN + 2.0,
-	.y           = Y_MAX - 8.0,
-	.color       = GREEN,  /* WHITE */
-	.blink_on    = false,
-
-	.vt100  = {
-		.width        = VGA_WIDTH,
-		.height       = VGA_HEIGHT,
-		.size         = VGA_WIDTH * VGA_HEIGHT,
-		.cursor       = 0,
-		.cursor_saved = 0,
-		.state        = TERMINAL_NORMAL_MODE,
-		.cursor_on    = true,
-		.blinks       = false,
-		.n1           = 1,
-		.n2           = 1,
-		.m            = { 0 },
-		.attribute    = { 0 },
-		.attributes   = { { 0 } },
-	},
-	.texture = &vga_background_texture
-};
+	free(line_a);
+	free(line_m);
+	free(r.wrapped);
+	free(r.attributes);
+	free(r.m);
+}
 
+/* ====================================== FIFO ================================================= */
 
-static fifo_t *uart_rx_fifo = NULL;
-static fifo_t *uart_tx_fifo = NULL;
+/**@brief make a FIFO holding at least 'size' items, rounded up to a power
+ * of two */
+fifo_t *fifo_new(size_t size)
+{
+	assert(size >= 2); /* It does not make sense to have a FIFO less than this size */
+	size_t rounded = 2;
+	while(rounded < size)
+		rounded <<= 1;
+	fifo_data_t *buffer = allocate_or_die(rounded * sizeof(buffer[0]));
+	fifo_t *fifo = allocate_or_die(sizeof(fifo_t));
 
-/* ====================================== Simulator Instances ================================== */
+	fifo->buffer = buffer;
+	fifo->head   = 0;
+	fifo->tail   = 0;
+	fifo->size   = rounded;
+	fifo->mask   = rounded - 1;
 
-/* ====================================== Main Loop ============================================ */
+	return fifo;
+}
 
-/*static double fps(void)
+void fifo_free(fifo_t *fifo)
 {
-	static unsigned frame = 0, timebase = 0;
-	static double fps = 0;
-	int time = glutGet(GLUT_ELAPSED_TIME);
-	frame++;
-	if(time - timebase > 1000) {
-		fps = frame*1000.0/(time-timebase);
-		timebase = time;
-		frame = 0;
-	}
-	return fps;
-}*/
+	if(!fifo)
+		return;
+	free(fifo->buffer);
+	free(fifo);
+}
 
-static void keyboard_handler(unsigned char key, int x, int y)
+/* The producer publishes 'head' with a release store once the data is in
+ * place and the consumer reads it with an acquire load before touching the
+ * data, likewise for 'tail' the other way around. */
+
+static size_t fifo_load(const size_t *index)
 {
-	UNUSED(x);
-	UNUSED(y);
-	assert(uart_tx_fifo);
-	if(key == ESCAPE) {
-		world.halt_simulation = true;
-	} else {
-		vt100_update(&vga_terminal.vt100, key);
-		//fifo_push(uart_rx_fifo, key);
-	}
+	return __atomic_load_n(index, __ATOMIC_ACQUIRE);
 }
 
-static void keyboard_special_handler(int key, int x, int y)
-{
-	UNUSED(x);
-	UNUSED(y);
-	vt100_update(&vga_terminal.vt100, key);
-	switch(key) {
-	case GLUT_KEY_UP:    
-	case GLUT_KEY_LEFT:  
-	case GLUT_KEY_RIGHT: 
-	case GLUT_KEY_DOWN:  
-	case GLUT_KEY_F1:   
-	case GLUT_KEY_F2:  
-	case GLUT_KEY_F3: 
-	case GLUT_KEY_F4:  
-	case GLUT_KEY_F5:  
-	case GLUT_KEY_F6:  
-	case GLUT_KEY_F7:  
-	case GLUT_KEY_F8:  
-	case GLUT_KEY_F9:  
-	case GLUT_KEY_F10: 
-	case GLUT_KEY_F11: 
-	case GLUT_KEY_F12: 
-	default:
-		break;
-	}
+static void fifo_store(size_t *index, size_t value)
+{
+	__atomic_store_n(index, value, __ATOMIC_RELEASE);
 }
 
-static void keyboard_special_up_handler(int key, int x, int y)
+size_t fifo_count(fifo_t * fifo)
 {
-	UNUSED(x);
-	UNUSED(y);
-	switch(key) {
-	case GLUT_KEY_UP:   
-	case GLUT_KEY_LEFT: 
-	case GLUT_KEY_RIGHT:
-	case GLUT_KEY_DOWN: 
-	default:
-		break;
-	}
+	assert(fifo);
+	return fifo_load(&fifo->head) - fifo_load(&fifo->tail);
 }
 
-typedef struct {
-	double x;
-	double y;
-} coordinate_t;
-
-static void resize_window(int w, int h)
-{
-	double window_x_min, window_x_max, window_y_min, window_y_max;
-	double scale, center;
-	world.window_width  = w;
-	world.window_height = h;
-
-	glViewport(0, 0, w, h);
-
-	w = (w == 0) ? 1 : w;
-	h = (h == 0) ? 1 : h;
-	if ((X_MAX - X_MIN) / w < (Y_MAX - Y_MIN) / h) {
-		scale = ((Y_MAX - Y_MIN) / h) / ((X_MAX - X_MIN) / w);
-		center = (X_MAX + X_MIN) / 2;
-		window_x_min = center - (center - X_MIN) * scale;
-		window_x_max = center + (X_MAX - center) * scale;
-		world.window_scale_x = scale;
-		window_y_min = Y_MIN;
-		window_y_max = Y_MAX;
-	} else {
-		scale = ((X_MAX - X_MIN) / w) / ((Y_MAX - Y_MIN) / h);
-		center = (Y_MAX + Y_MIN) / 2;
-		window_y_min = center - (center - Y_MIN) * scale;
-		window_y_max = center + (Y_MAX - center) * scale;
-		world.window_scale_y = scale;
-		window_x_min = X_MIN;
-		window_x_max = X_MAX;
-	}
+bool fifo_is_full(fifo_t * fifo)
+{
+	return fifo_count(fifo) == fifo->size;
+}
 
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	glOrtho(window_x_min, window_x_max, window_y_min, window_y_max, -1, 1);
+bool fifo_is_empty(fifo_t * fifo)
+{
+	return fifo_count(fifo) == 0;
 }
 
-static void mouse_handler(int button, int state, int x, int y)
+/**@brief get the longest run of free slots that can be written to without
+ * wrapping, returns its length, which is zero if the FIFO is full. Only the
+ * producer may call this, fifo_write_commit() hands the items over. */
+size_t fifo_write_span(fifo_t *fifo, fifo_data_t **span)
 {
-	UNUSED(button);
-	UNUSED(state);
-	UNUSED(x);
-	UNUSED(y);
+	assert(fifo);
+	assert(span);
+	const size_t head = fifo->head, room = fifo->size - (head - fifo_load(&fifo->tail));
+	*span = &fifo->buffer[head & fifo->mask];
+	return MIN(room, fifo->size - (head & fifo->mask));
 }
 
-static void timer_callback(int value)
+void fifo_write_commit(fifo_t *fifo, size_t n)
 {
-	world.tick++;
-	glutTimerFunc(world.arena_tick_ms, timer_callback, value);
+	assert(fifo);
+	assert(n <= fifo->size - (fifo->head - fifo_load(&fifo->tail)));
+	fifo_store(&fifo->head, fifo->head + n);
 }
 
-static void draw_scene(void)
+/**@brief get the longest run of items that can be read without wrapping,
+ * returns its length, which is zero if the FIFO is empty. Only the consumer
+ * may call this, fifo_read_commit() gives the slots back. */
+size_t fifo_read_span(fifo_t *fifo, const fifo_data_t **span)
 {
-	static uint64_t next = 0;
-	static uint64_t count = 0;
-	//double f = fps();
-	if(world.halt_simulation)
-		exit(EXIT_SUCCESS);
+	assert(fifo);
+	assert(span);
+	const size_t tail = fifo->tail, used = fifo_load(&fifo->head) - tail;
+	*span = &fifo->buffer[tail & fifo->mask];
+	return MIN(used, fifo->size - (tail & fifo->mask));
+}
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void fifo_read_commit(fifo_t *fifo, size_t n)
+{
+	assert(fifo);
+	assert(n <= fifo_load(&fifo->head) - fifo->tail);
+	fifo_store(&fifo->tail, fifo->tail + n);
+}
 
-	if(next != world.tick) {
-		next = world.tick;
-		count++;
-		/*for(;!fifo_is_empty(uart_tx_fifo);) {
-			uint8_t c = 0;
-			fifo_pop(uart_tx_fifo, &c);
-			vt100_update(&uart_terminal.vt100, c);
-		}*/
+/**@brief push up to 'n' items, returns how many there was room for */
+size_t fifo_push_n(fifo_t *fifo, const fifo_data_t *data, size_t n)
+{
+	assert(fifo);
+	assert(data || !n);
+	size_t done = 0;
+	for(unsigned i = 0; i < 2 && done < n; i++) { /* at most two spans, either side of the wrap */
+		fifo_data_t *span = NULL;
+		const size_t room = fifo_write_span(fifo, &span), m = MIN(n - done, room);
+		if(!m)
+			break;
+		memcpy(span, &data[done], m * sizeof(data[0]));
+		fifo_write_commit(fifo, m);
+		done += m;
 	}
-	draw_terminal(&world, &vga_terminal, "VT100");
-	draw_texture(&vga_terminal,  !(count % 2));
+	return done;
+}
 
-	glFlush();
-	glutSwapBuffers();
-	glutPostRedisplay();
+/**@brief pop up to 'n' items, returns how many there were */
+size_t fifo_pop_n(fifo_t *fifo, fifo_data_t *data, size_t n)
+{
+	assert(fifo);
+	assert(data || !n);
+	size_t done = 0;
+	for(unsigned i = 0; i < 2 && done < n; i++) {
+		const fifo_data_t *span = NULL;
+		const size_t used = fifo_read_span(fifo, &span), m = MIN(n - done, used);
+		if(!m)
+			break;
+		memcpy(&data[done], span, m * sizeof(data[0]));
+		fifo_read_commit(fifo, m);
+		done += m;
+	}
+	return done;
 }
 
-static void initialize_rendering(char *arg_0)
+size_t fifo_push(fifo_t * fifo, fifo_data_t data)
 {
-	char *glut_argv[] = { arg_0, NULL };
-	int glut_argc = 0;
-	memset(vga_terminal.vt100.m, ' ', vga_terminal.vt100.size);
-	glutInit(&glut_argc, glut_argv);
-	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH );
-	glutInitWindowPosition(world.window_x_starting_position, world.window_y_starting_position);
-	glutInitWindowSize(world.window_width, world.window_height);
-	glutCreateWindow("VT100 Terminal Emulator");
-	glShadeModel(GL_FLAT);
-	glEnable(GL_DEPTH_TEST);
-	glutKeyboardFunc(keyboard_handler);
-	glutSpecialFunc(keyboard_special_handler);
-	glutSpecialUpFunc(keyboard_special_up_handler);
-	glutMouseFunc(mouse_handler);
-	glutReshapeFunc(resize_window);
-	glutDisplayFunc(draw_scene);
-	glutTimerFunc(world.arena_tick_ms, timer_callback, 0);
+	assert(fifo);
+	const size_t head = fifo->head;
+	if(head - fifo_load(&fifo->tail) == fifo->size)
+		return 0;
+	fifo->buffer[head & fifo->mask] = data;
+	fifo_store(&fifo->head, head + 1);
+	return 1;
 }
 
-static void vt100_initialize(vt100_t *v)
+size_t fifo_pop(fifo_t * fifo, fifo_data_t * data)
 {
-	assert(v);
-	memset(&v->attribute, 0, sizeof(v->attribute));
-	v->attribute.foreground_color = WHITE;
-	v->attribute.background_color = BLACK;
-	for(size_t i = 0; i < v->size; i++)
-		v->attributes[i] = v->attribute;
+	assert(fifo);
+	assert(data);
+	const size_t tail = fifo->tail;
+	if(fifo_load(&fifo->head) == tail)
+		return 0;
+	*data = fifo->buffer[tail & fifo->mask];
+	fifo_store(&fifo->tail, tail + 1);
+	return 1;
 }
 
-static void finalize(void)
+/* ====================================== PTY ================================================== */
+
+/* A shell runs on the slave side of a pseudo terminal. A reader thread
+ * copies its output from the master side into a FIFO as soon as it arrives,
+ * and the display thread feeds what has arrived to the emulator in batches,
+ * so a slow frame does not hold up the child. If the FIFO fills up the
+ * reader stops reading and the child blocks until there is room again. Key
+ * presses are written straight back to the master side. */
+
+#define PTY_READ_CHUNK  (1 << 16)
+#define PTY_PARSE_CHUNK (1 << 14) /* bytes parsed between looking at the clock */
+#define PTY_FIFO_SIZE   (1 << 20)
+#define PTY_POLL_MS     (100)
+#define PTY_FULL_NS     (1000000l) /* wait for the FIFO to drain */
+
+/**@brief read the child's output straight into the free space of the FIFO */
+static void *pty_reader(void *arg)
 {
-	fifo_free(uart_tx_fifo);
-	fifo_free(uart_rx_fifo);
+	pty_t *p = arg;
+	assert(p);
+	while(!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+		fifo_data_t *span = NULL;
+		size_t room = fifo_write_span(p->output, &span);
+		room = MIN(room, PTY_READ_CHUNK);
+		if(!room) {
+			const struct timespec wait = { .tv_sec = 0, .tv_nsec = PTY_FULL_NS };
+			nanosleep(&wait, NULL);
+			continue;
+		}
+		struct pollfd fd = { .fd = p->master, .events = POLLIN };
+		const int ready = poll(&fd, 1, PTY_POLL_MS);
+		if(ready == 0 || (ready < 0 && errno == EINTR))
+			continue;
+		errno = 0;
+		const ssize_t r = ready < 0 ? -1 : read(p->master, span, room);
+		if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			continue;
+		if(r <= 0) /* EIO, the slave side has been closed */
+			break;
+		fifo_write_commit(p->output, r);
+	}
+	__atomic_store_n(&p->eof, true, __ATOMIC_RELEASE);
+	return NULL;
 }
 
-int main(int argc, char **argv)
+pty_t *pty_new(const char *shell, unsigned width, unsigned height)
 {
-	assert(Y_MAX > 0. && Y_MIN < Y_MAX && Y_MIN >= 0.);
-	assert(X_MAX > 0. && X_MIN < X_MAX && X_MIN >= 0.);
+	assert(shell);
+	pty_t *p = allocate_or_die(sizeof(*p));
+	const char *name = NULL;
 
-	log_level = LOG_NOTE;
+	errno = 0;
+	if((p->master = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+		fatal("posix_openpt failed: %s", reason());
+	if(grantpt(p->master) < 0 || unlockpt(p->master) < 0 || !(name = ptsname(p->master)))
+		fatal("could not set up pseudo terminal: %s", reason());
+	pty_resize(p, width, height);
+
+	if((p->child = fork()) < 0)
+		fatal("fork failed: %s", reason());
+	if(p->child == 0) { /* the slave becomes our controlling terminal on open */
+		int slave = -1;
+		if(setsid() < 0 || (slave = open(name, O_RDWR)) < 0)
+			_exit(EXIT_FAILURE);
+		dup2(slave, STDIN_FILENO);
+		dup2(slave, STDOUT_FILENO);
+		dup2(slave, STDERR_FILENO);
+		if(slave > STDERR_FILENO)
+			close(slave);
+		close(p->master);
+		setenv("TERM", "vt100", 1);
+		execl(shell, shell, (char*)NULL);
+		_exit(127);
+	}
 
-	uart_rx_fifo = fifo_new(UART_FIFO_DEPTH);
-	uart_tx_fifo = fifo_new(UART_FIFO_DEPTH * 100); /** @note x100 to speed things up */
+	if(fcntl(p->master, F_SETFL, fcntl(p->master, F_GETFL) | O_NONBLOCK) < 0)
+		fatal("could not make pseudo terminal non-blocking: %s", reason());
+	p->output = fifo_new(PTY_FIFO_SIZE);
+	if((errno = pthread_create(&p->reader, NULL, pty_reader, p)))
+		fatal("could not start reader thread: %s", reason());
+	note("started '%s' on %s, pid %ld", shell, name, (long)p->child);
+	return p;
+}
+
+void pty_free(pty_t *p)
+{
+	if(!p)
+		return;
+	__atomic_store_n(&p->stop, true, __ATOMIC_RELEASE);
+	if(!__atomic_load_n(&p->eof, __ATOMIC_ACQUIRE))
+		kill(p->child, SIGHUP);
+	pthread_join(p->reader, NULL);
+	close(p->master);
+	waitpid(p->child, NULL, 0);
+	fifo_free(p->output);
+	free(p);
+}
 
-	vt100_initialize(&vga_terminal.vt100);
+double seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
 
-	atexit(finalize);
-	initialize_rendering(argv[0]);
-	glutMainLoop();
+/**@brief feed what the reader thread has collected so far to the emulator
+ * until 'budget' seconds have gone by, anything left over or arriving while
+ * this runs is left for next time, returns the number of bytes used */
+size_t pty_drain(pty_t *p, vt100_t *t, double budget)
+{
+	assert(p);
+	assert(t);
+	const bool eof = __atomic_load_n(&p->eof, __ATOMIC_ACQUIRE);
+	const double start = seconds();
+	size_t total = 0, available = fifo_count(p->output);
+	while(total < available && (seconds() - start) < budget) {
+		const fifo_data_t *span = NULL;
+		size_t n = fifo_read_span(p->output, &span);
+		n = MIN(n, available - total);
+		n = MIN(n, PTY_PARSE_CHUNK);
+		if(!n)
+			break;
+		vt100_write(t, span, n);
+		fifo_read_commit(p->output, n);
+		total += n;
+	}
+	if(eof && fifo_is_empty(p->output))
+		p->closed = true;
+	return total;
+}
 
-	return 0;
+void pty_write(pty_t *p, const uint8_t *buf, size_t len)
+{
+	assert(p);
+	assert(buf);
+	while(len && !(p->closed)) {
+		errno = 0;
+		const ssize_t r = write(p->master, buf, len);
+		if(r < 0) {
+			if(errno == EINTR)
+				continue;
+			warning("dropped %zu bytes of input: %s", len, reason());
+			return;
+		}
+		buf += r;
+		len -= r;
+	}
 }
 
+/**@brief tell the program on the pseudo terminal its new size, the kernel
+ * sends its process group SIGWINCH, call this along with vt100_resize() */
+void pty_resize(pty_t *p, unsigned width, unsigned height)
+{
+	assert(p);
+	struct winsize size = { .ws_row = height, .ws_col = width };
+	errno = 0;
+	if(ioctl(p->master, TIOCSWINSZ, &size) < 0)
+		warning("could not set terminal size: %s", reason());
+}
 
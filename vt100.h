@@ -0,0 +1,325 @@
+/**@file      vt100.h
+ * @brief     VT100 terminal state machine and screen model, along with the
+ *            FIFO and pseudo terminal that feed it, none of which needs any
+ *            graphics library
+ * @copyright Richard James Howe (2017)
+ * @license   MIT */
+
+#ifndef VT100_H
+#define VT100_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define MAX(X, Y)        ((X) > (Y) ? (X) : (Y))
+#define MIN(X, Y)        ((X) < (Y) ? (X) : (Y))
+#define UNUSED(X)        ((void)(X))
+
+#define CACHE_LINE_SIZE            (64)
+
+typedef enum { /**@warning do not change the order or insert elements */
+	BLACK,
+	RED,
+	GREEN,
+	YELLOW,
+	BLUE,
+	MAGENTA,
+	CYAN,
+	WHITE,
+} color_t;
+
+/**@brief the states of the DEC ANSI parser, see
+ * <https://vt100.net/emu/dec_ansi_parser> */
+typedef enum {
+	TERMINAL_GROUND,
+	TERMINAL_ESCAPE,
+	TERMINAL_ESCAPE_INTERMEDIATE,
+	TERMINAL_CSI_ENTRY,
+	TERMINAL_CSI_PARAM,
+	TERMINAL_CSI_INTERMEDIATE,
+	TERMINAL_CSI_IGNORE,
+	TERMINAL_DCS_ENTRY,
+	TERMINAL_DCS_PARAM,
+	TERMINAL_DCS_INTERMEDIATE,
+	TERMINAL_DCS_PASSTHROUGH,
+	TERMINAL_DCS_IGNORE,
+	TERMINAL_OSC_STRING,
+	TERMINAL_SOS_STRING, /* also PM and APC strings */
+	TERMINAL_STATE_END,
+} terminal_state_t;
+
+#define VT100_PARAMETERS    (16)
+#define VT100_PARAMETER_MAX (UINT16_MAX)
+#define VT100_INTERMEDIATES (2)
+#define VT100_OSC_LENGTH    (256)
+
+/**@brief the attributes of a cell packed into a word, the colors are held
+ * in the low bytes and the flags above them, use the accessors below rather
+ * than shifting and masking by hand. A color is an index into the xterm 256
+ * color palette, the first eight of which are color_t, vt100_palette()
+ * turns one into RGB. */
+typedef uint32_t vt100_attribute_t;
+
+#define VT100_FOREGROUND_SHIFT (0)
+#define VT100_BACKGROUND_SHIFT (8)
+#define VT100_COLOR_MASK       (0xFFu)
+
+#define VT100_BOLD_BIT          (16)
+#define VT100_UNDER_SCORE_BIT   (17)
+#define VT100_BLINK_BIT         (18)
+#define VT100_REVERSE_VIDEO_BIT (19)
+#define VT100_CONCEAL_BIT       (20)
+
+#define VT100_BOLD              (1u << VT100_BOLD_BIT)
+#define VT100_UNDER_SCORE       (1u << VT100_UNDER_SCORE_BIT)
+#define VT100_BLINK             (1u << VT100_BLINK_BIT)
+#define VT100_REVERSE_VIDEO     (1u << VT100_REVERSE_VIDEO_BIT)
+#define VT100_CONCEAL           (1u << VT100_CONCEAL_BIT)
+
+#define VT100_ATTRIBUTE(FOREGROUND, BACKGROUND, FLAGS)\
+	((((vt100_attribute_t)(FOREGROUND) & VT100_COLOR_MASK) << VT100_FOREGROUND_SHIFT)\
+	| (((vt100_attribute_t)(BACKGROUND) & VT100_COLOR_MASK) << VT100_BACKGROUND_SHIFT)\
+	| (vt100_attribute_t)(FLAGS))
+
+static inline unsigned vt100_foreground(vt100_attribute_t a)
+{
+	return (a >> VT100_FOREGROUND_SHIFT) & VT100_COLOR_MASK;
+}
+
+static inline unsigned vt100_background(vt100_attribute_t a)
+{
+	return (a >> VT100_BACKGROUND_SHIFT) & VT100_COLOR_MASK;
+}
+
+static inline vt100_attribute_t vt100_foreground_set(vt100_attribute_t a, unsigned color)
+{
+	return (a & ~(VT100_COLOR_MASK << VT100_FOREGROUND_SHIFT)) | ((color & VT100_COLOR_MASK) << VT100_FOREGROUND_SHIFT);
+}
+
+static inline vt100_attribute_t vt100_background_set(vt100_attribute_t a, unsigned color)
+{
+	return (a & ~(VT100_COLOR_MASK << VT100_BACKGROUND_SHIFT)) | ((color & VT100_COLOR_MASK) << VT100_BACKGROUND_SHIFT);
+}
+
+static inline bool vt100_flag(vt100_attribute_t a, vt100_attribute_t flag)
+{
+	return !!(a & flag);
+}
+
+#define VT100_SCROLLBACK_LINES (1000)
+#define VT100_SCROLLBACK_FILE_LINES (1u << 22) /* the index of which takes 64MiB of the file */
+#define VT100_REFLOW_LINES (VT100_SCROLLBACK_LINES) /* most lines of scrollback a resize reflows */
+
+/**@brief a run of cells of a scrollback line with the same attribute */
+typedef struct {
+	vt100_attribute_t attribute;
+	uint32_t count;
+} vt100_run_t;
+
+/**@brief where a line of the scrollback is in the arena, its 'runs'
+ * attribute runs are followed by its 'length' characters, the blanks at the
+ * end of the line are not kept */
+typedef struct {
+	size_t offset;
+	uint32_t length;
+	uint16_t runs;
+	bool wrapped; /* line continues on the next line */
+} vt100_line_t;
+
+#define VT100_SEGMENT_SIZE (1u << 20)
+
+/**@brief lines that have scrolled off the top of the screen, kept in a ring
+ * that grows to a fixed depth, after which the oldest line is dropped. The
+ * lines are compacted and appended to an arena, the space used by dropped
+ * lines is reclaimed when the arena fills up. The arena can instead be a
+ * file, mapped a segment of VT100_SEGMENT_SIZE bytes at a time, with the
+ * index mapped from the start of the same file. A line is
+ * only expanded back into cells when it is looked at, into a cache with a
+ * slot per display row. A resize only reflows the newest VT100_REFLOW_LINES
+ * lines, older lines are cut or padded to fit the display. */
+typedef struct {
+	vt100_line_t *index; /* ring of 'capacity' lines */
+	size_t capacity;     /* grows up to 'lines' */
+	uint8_t *arena;      /* on the heap, if there is no file */
+	uint8_t **segment;   /* or a ring of the mapped segments of the file, NULL once unmapped */
+	size_t *place;       /* per segment in segment[], where it is in the file, in segments */
+	size_t segments;     /* ever mapped, the arena is this many segments long */
+	size_t segments_max; /* that segment[] and place[] can hold */
+	size_t unmapped;     /* segments before this only held dropped lines */
+	size_t recycled;     /* unmapped segments before this have had their place used again */
+	size_t file_segments; /* places for segments in the file, after the index */
+	int fd;              /* of the file, or -1 */
+	size_t arena_start;  /* everything before this belongs to dropped lines */
+	size_t arena_used;
+	size_t arena_size;
+	uint8_t *m;          /* the cache of expanded lines */
+	vt100_attribute_t *attributes;
+	size_t *cached;      /* per slot of the cache, the line it holds, by serial number */
+	size_t slots;
+	size_t lines;  /* most lines held */
+	size_t head;   /* next line to be written */
+	size_t count;  /* number of lines held, at most 'lines' */
+	size_t pushed; /* number of lines ever pushed, the serial number of the next */
+	unsigned width; /* of the display, older lines may have been written at another */
+} vt100_scrollback_t;
+
+/**@brief the area of the display that has changed since the damage was
+ * last cleared, 'x1' and 'y1' are one past the end, it is empty if 'x0' is
+ * not less than 'x1' */
+typedef struct {
+	unsigned x0, y0, x1, y1;
+} vt100_damage_t;
+
+/**@brief the cells of a screen, the normal and alternate screens each
+ * have a set, see vt100_t for what the fields mean */
+typedef struct {
+	uint8_t *m;
+	vt100_attribute_t *attributes;
+	uint8_t *wrapped;
+	unsigned *rows;
+	unsigned top;
+} vt100_screen_t;
+
+/**@note the screen is a ring of rows, display row 'y' shows row
+ * 'rows[(top + y) % height]' of m[] and attributes[], so scrolling the
+ * whole screen moves 'top' and scrolling part of it shuffles rows[], the
+ * cells themselves stay put. 'cursor' is relative to the display and not an
+ * index into m[]. The cells are allocated to fit the screen by vt100_new()
+ * and vt100_resize(). The fields of whichever screen is
+ * not being shown, the normal or alternate one, are kept in 'other'. */
+typedef struct {
+	size_t cursor;
+	size_t cursor_saved;
+	size_t cursor_alternate_saved; /* the cursor on the normal screen, when the alternate one is up */
+	unsigned height;
+	unsigned width;
+	unsigned size;
+	unsigned top;
+	unsigned scroll_top;    /* the scroll region, set with DECSTBM, is the rows */
+	unsigned scroll_bottom; /* from 'scroll_top' up to but not 'scroll_bottom' */
+	uint8_t state; /* a terminal_state_t */
+	uint8_t parameter_count;    /* one more than VT100_PARAMETERS if there were too many */
+	uint8_t intermediate_count; /* likewise for VT100_INTERMEDIATES */
+	uint8_t private_marker;     /* one of '<', '=', '>' or '?', or zero */
+	uint16_t parameters[VT100_PARAMETERS]; /* zero if not given */
+	uint8_t intermediates[VT100_INTERMEDIATES];
+	size_t osc_length;
+	char osc[VT100_OSC_LENGTH]; /* operating system command being collected */
+	char title[VT100_OSC_LENGTH]; /* set with OSC 0 or 2, NUL terminated */
+	bool blinks;
+	bool cursor_on;
+	bool alternate; /* the alternate screen is being shown */
+	bool wrap_pending; /* the last column has been printed to, the next character starts a new row */
+	bool cursor_keys;  /* DECCKM, the arrow keys send 'ESC O x' instead of 'ESC [ x' */
+	vt100_attribute_t attribute;
+	vt100_attribute_t *attributes;
+	uint8_t *m;
+	unsigned *rows;   /* per slot of the ring, the row of m[] in it */
+	uint8_t *wrapped; /* per row of m[], text runs on to the next row */
+	uint8_t *dirty;   /* per row of the display, not of m[] */
+	vt100_damage_t damage;
+	vt100_scrollback_t scrollback;
+	vt100_screen_t other;
+} vt100_t;
+
+typedef uint8_t fifo_data_t;
+
+/**@brief a ring buffer that one thread may push to while another pops from
+ * it without any locking, each index is only written by one side and they
+ * are kept on separate cache lines so the two threads do not fight over
+ * them. The size is a power of two and the indices count up forever, they
+ * are masked to find a slot, so 'head - tail' is always the number of items
+ * held and every slot can be used. */
+typedef struct {
+	size_t head; /* items ever written, owned by the producer */
+	uint8_t pad_head[CACHE_LINE_SIZE - sizeof(size_t)];
+	size_t tail; /* items ever read, owned by the consumer */
+	uint8_t pad_tail[CACHE_LINE_SIZE - sizeof(size_t)];
+	size_t size; /* a power of two */
+	size_t mask; /* size - 1 */
+	fifo_data_t *buffer;
+} fifo_t;
+
+/** @warning LOG_FATAL level kills the program */
+#define X_MACRO_LOGGING\
+	X(LOG_MESSAGE_OFF,  "")\
+	X(LOG_FATAL,        "fatal")\
+	X(LOG_ERROR,        "error")\
+	X(LOG_WARNING,      "warning")\
+	X(LOG_NOTE,         "note")\
+	X(LOG_DEBUG,        "debug")\
+	X(LOG_ALL_MESSAGES, "any")
+
+typedef enum {
+#define X(ENUM, NAME) ENUM,
+	X_MACRO_LOGGING
+#undef X
+} log_level_e;
+
+extern log_level_e log_level; /* messages above this level are not printed */
+
+int logger(log_level_e level, const char *func, const unsigned line, const char *fmt, ...);
+void *allocate_or_die(size_t length);
+FILE *fopen_or_die(const char *file, const char *mode);
+double seconds(void);
+
+#define fatal(FMT, ...)   logger(LOG_FATAL,   __func__, __LINE__, FMT, ##__VA_ARGS__)
+#define error(FMT, ...)   logger(LOG_ERROR,   __func__, __LINE__, FMT, ##__VA_ARGS__)
+#define warning(FMT, ...) logger(LOG_WARNING, __func__, __LINE__, FMT, ##__VA_ARGS__)
+#define note(FMT, ...)    logger(LOG_NOTE,    __func__, __LINE__, FMT, ##__VA_ARGS__)
+#define debug(FMT, ...)   logger(LOG_DEBUG,   __func__, __LINE__, FMT, ##__VA_ARGS__)
+#define BELL      (7)
+#define BACKSPACE (8)
+#define ESCAPE    (27)
+#define DELETE    (127)  /* ASCII delete */
+
+vt100_t *vt100_new(unsigned width, unsigned height, size_t scrollback);
+void vt100_free(vt100_t *t);
+void vt100_resize(vt100_t *t, unsigned width, unsigned height);
+void vt100_update(vt100_t *t, uint8_t c);
+void vt100_write(vt100_t *t, const uint8_t *buf, size_t len);
+void vt100_scrollback(vt100_t *t, size_t lines);
+void vt100_scrollback_file(vt100_t *t, const char *file, size_t lines);
+bool vt100_row(vt100_t *t, size_t back, unsigned y, const uint8_t **m, const vt100_attribute_t **attributes);
+bool vt100_damaged(const vt100_t *t, vt100_damage_t *damage);
+bool vt100_row_dirty(const vt100_t *t, unsigned y);
+void vt100_damage_all(vt100_t *t);
+void vt100_damage_clear(vt100_t *t);
+const char *vt100_scanner(void);
+void vt100_palette(unsigned color, uint8_t rgb[3]);
+
+typedef struct {
+	int master;
+	pid_t child;
+	pthread_t reader;
+	fifo_t *output;
+	bool eof;    /* reader: the child has gone away, set atomically */
+	bool stop;   /* display: the reader should exit, set atomically */
+	bool closed; /* display: end of file and everything has been used */
+} pty_t;
+
+fifo_t *fifo_new(size_t size);
+void fifo_free(fifo_t *fifo);
+size_t fifo_count(fifo_t *fifo);
+bool fifo_is_full(fifo_t *fifo);
+bool fifo_is_empty(fifo_t *fifo);
+size_t fifo_write_span(fifo_t *fifo, fifo_data_t **span);
+void fifo_write_commit(fifo_t *fifo, size_t n);
+size_t fifo_read_span(fifo_t *fifo, const fifo_data_t **span);
+void fifo_read_commit(fifo_t *fifo, size_t n);
+size_t fifo_push_n(fifo_t *fifo, const fifo_data_t *data, size_t n);
+size_t fifo_pop_n(fifo_t *fifo, fifo_data_t *data, size_t n);
+size_t fifo_push(fifo_t *fifo, fifo_data_t data);
+size_t fifo_pop(fifo_t *fifo, fifo_data_t *data);
+
+pty_t *pty_new(const char *shell, unsigned width, unsigned height);
+void pty_free(pty_t *p);
+size_t pty_drain(pty_t *p, vt100_t *t, double budget);
+void pty_write(pty_t *p, const uint8_t *buf, size_t len);
+void pty_resize(pty_t *p, unsigned width, unsigned height);
+
+#endif